@@ -1,55 +1,151 @@
 #pragma once
 #include "TT.h"
+#include "PawnTable.h"
+#include "EvalCache.h"
+#include <memory>
+#include <functional>
+#include <vector>
+#include <atomic>
 
 
 
+// one root move and the line behind it, as found by a multipv pass
+struct RootLine {
+	int score;
+	int length;
+	Move moves[max_ply];
+};
+
+
 class ChessEngine {
 public:
-	ChessEngine() : quit(false), Table(HASH_SIZE), count(0), ply(0), repetitionIndex(0),offset(0){ }
+	ChessEngine() : ChessEngine(std::make_shared<TTable>(HASH_SIZE)) { }
+
+	// engines constructed with the same table share it, probing and writing it concurrently is safe
+	explicit ChessEngine(std::shared_ptr<TTable> table) : repetitionIndex(0), Table(table), BestLineLength(0), offset(0), quit(false), stop(false), ponder(false), silent(false),
+		maxNodes(0), ply(0), count(0), completedDepth(0), bestScore(0), multiPV(1), rootLineCount(0), sharedCount(0), nextYield(0), nextCheck(0), excludedCount(0) { NewGame(); }
 
+	// lazy smp, every helper thread runs the same iterative deepening on its own search state and
+	// they only talk through the shared transposition table. when the search ends the threads vote on the move
 	Move BestMove(int maxDdepth, const Board& board);
 
-	void RunPerftTest(int depth, const Board& board);
+	// the engine itself is the first thread, threads - 1 helpers are created to search next to it
+	void SetThreads(int threads);
+
+	// ends the search on every thread, safe to call from any thread
+	void Stop();
+
+	void ResizeEvalCache(size_t mb);
+
+	// nodes of this engine and all its helpers, while searching the helpers only report every few thousand nodes
+	int64_t NodesSearched() const;
+
+	// counts the leaves depth plies down and prints them per root move, the tree is split over threads.
+	// with hashMB the threads share a table of subtree counts that size
+	void RunPerftTest(int depth, const Board& board, int threads = 1, size_t hashMB = 0);
+
+	// forgets the move ordering heuristics, the transposition table is left alone and ages out on its own
+	void NewGame();
+
+	// the moves to mate for a score found searching depth plies, negative when the side to move is the one
+	// mated and 0 when the score is no mate
+	static int MateMoves(int score, int depth);
 
 
 	uint64_t repetitionTable[max_repetition];
 	int repetitionIndex;
-	TTable Table;
+	std::shared_ptr<TTable> Table;
+
+	EvalCache evalCache;
 
 	Move BestLine[max_ply];
+	int BestLineLength;
 
 	int offset;
 
 	bool quit;
-	bool stop;
+	std::atomic<bool> stop;
+
+	// while set the search ignores the clock and holds its bestmove back until it is cleared or stopped.
+	// go ponder sets it until ponderhit, go infinite until stop
+	std::atomic<bool> ponder;
+
+	// searches without printing info lines or the bestmove, for engines that aren't talking to a gui
+	bool silent;
+
+	// called every YIELD_NODES nodes, a scheduler running many searches on one thread switches to another one in it
+	std::function<void()> yield;
 	int startTime;
 
 	double maxTime;
+
+	// 0 for no limit, counts the nodes of the helpers too
+	int64_t maxNodes;
 	int ply;
-	int count;
+	int64_t count;
+
+	// the last depth this engine finished and the score it got there
+	int completedDepth;
+	int bestScore;
+
+	// how many of the best root moves get a line of their own
+	int multiPV;
+
+	// the lines of the last finished depth, best first
+	RootLine rootLines[MULTIPV_MAX];
+	int rootLineCount;
+
+	// go searchmoves, the root only looks at these. empty searches every move
+	LegalMoves searchMoves;
 private:
+	std::vector<std::unique_ptr<ChessEngine>> helpers;
 
+	// count as seen by other threads, published from communicate
+	std::atomic<int64_t> sharedCount;
+
+	int64_t nextYield;
+	// count at which communicate looks at the clock and the node budget next
+	int64_t nextCheck;
+
+	// root moves the current multipv pass leaves out
+	Move excludedMoves[MULTIPV_MAX];
+	int excludedCount;
+
+
+	PawnTable pawnTable;
 
 	Move killer_moves[2][max_ply];
 
+	// the quiet move that last cut after a move, by the color and piece of that move and where it went
+	Move counter_moves[12][64];
+	// the move that led to the node NegMax is called for next, empty for a null move
+	Move lastMove;
+
 	int pv_length[max_ply];
 	Move pv_table[max_ply][max_ply];
 
 	int history_moves[12][64];
 
-	int score_move(Move move);
-	inline bool compareMoves(Move moveA, Move moveB);
-	void swapMoves(Move& moveA, Move& moveB);
+	// the incremental piece square eval plus the cached pawn terms, relative to the side to move
+	int evaluate(const Board& board);
 
 	bool IsRepetition(uint64_t hash);
 
-	int Perft(int depth, const Board& board);
+	uint64_t Perft(int depth, const Board& board, PerftTable* table = nullptr);
 
 	int NegMax(int depth, const Board& board, int alpha, int beta);
 	int quiescence(const Board& board, int alpha, int beta);
 
+	void iterate(int maxDepth, const Board& board, int firstDepth, bool isMain);
+	Move vote();
+	// the reply the search expects to best, taken from the pv or else from the table
+	Move ponderMove(const Board& board, Move best);
+
+	// publishes count and stops the search on the clock or the node budget, once count passed nextCheck
 	void communicate();
-	void clearTables();
+	// calls yield once count passed nextYield
+	void checkpoint();
+	void ageTables();
 	const int reductionLimits = 3;
 	const int fullDepthMoves = 4;
 };
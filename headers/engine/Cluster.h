@@ -0,0 +1,68 @@
+#pragma once
+#include "magic bitboard/Board.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// a search split over engine processes. every worker is a GrandChessUCI started with "listen <address>",
+// the coordinator gives each one a share of the root moves through go searchmoves and merges what
+// they report into one stream of info lines and a single bestmove
+class Cluster {
+public:
+	~Cluster() { Disconnect(); }
+
+	// addresses are unix:<path> or tcp:<host>:<port>, separated by commas. all of them or none are connected
+	bool Connect(const std::string& addresses);
+	void Disconnect();
+
+	bool Active() const { return !workers.empty(); }
+
+	// passes a line on to every worker, like setoption and ucinewgame
+	void Broadcast(const std::string& line);
+
+	// position and go are the lines from the gui. prints the merged info lines and the bestmove,
+	// when stop is set the workers are stopped and the best move they had is played
+	void Search(const std::string& position, const std::string& go, const Board& board, const std::atomic<bool>& stop);
+
+	// worker side, waits for one coordinator on the address and answers the uci commands a search needs until it quits.
+	// tcp:<port> without a host only listens on loopback
+	static bool Listen(const std::string& address);
+
+private:
+	// the best line a worker had at one depth
+	struct Report {
+		int depth;
+		// comparable over cp and mate scores, text is what the worker printed after "score"
+		int score;
+		std::string text;
+		std::string pv;
+	};
+
+	struct Worker {
+		int fd;
+		std::string address;
+		// bytes received that don't make a whole line yet
+		std::string input;
+
+		bool searching;
+		int64_t nodes;
+		std::vector<Report> reports;
+		std::string bestMove;
+	};
+
+	std::vector<Worker> workers;
+
+	// the search thread sends stop while the input loop passes ponderhit on
+	std::mutex sendLock;
+
+	bool send(Worker& worker, const std::string& line);
+	// reads whatever the worker sent, false once its connection is gone
+	bool receive(Worker& worker);
+	bool nextLine(Worker& worker, std::string& line);
+	void parse(Worker& worker, const std::string& line);
+
+	// the worker's line for a depth, a worker that finished early stands by its deepest one
+	const Report* reportAt(const Worker& worker, int depth) const;
+};
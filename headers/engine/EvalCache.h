@@ -0,0 +1,66 @@
+#pragma once
+#include "magic bitboard/Board.h"
+
+// direct mapped static eval cache keyed by Board::hashKey, transpositions, null move
+// children and quiescence stand pats keep asking for evals of positions already evaluated.
+// every entry is one word, the high half of the key next to the eval, so a lookup costs one load.
+// not shared between threads, every engine owns its own.
+// off by default, while the eval is only the incremental sum plus the pawn table a cache miss
+// costs more than evaluating
+struct EvalCache {
+	uint64_t* entries;
+
+	// always a power of two, 0 when the cache is switched off
+	size_t entryCount;
+
+	uint64_t probes;
+	uint64_t hits;
+
+	EvalCache(size_t mb = EVAL_CACHE_SIZE) : entries(0), entryCount(0), probes(0), hits(0) {
+		Resize(mb);
+	}
+
+	~EvalCache() {
+		delete[] entries;
+	}
+
+	EvalCache(const EvalCache&) = delete;
+	EvalCache& operator=(const EvalCache&) = delete;
+
+	// size is in MiB and rounded down to a power of two entries, 0 turns the cache off
+	void Resize(size_t mb);
+
+	void clear();
+
+	inline bool Probe(uint64_t key, int* eval) {
+		if (!entryCount) {
+			return false;
+		}
+
+		probes++;
+
+		const uint64_t entry = entries[key & (entryCount - 1)];
+		if ((entry ^ key) >> 32) {
+			return false;
+		}
+
+		hits++;
+		*eval = (int32_t)(uint32_t)entry;
+		return true;
+	}
+
+	inline void Store(uint64_t key, int eval) {
+		if (entryCount) {
+			entries[key & (entryCount - 1)] = (key & 0xffffffff00000000ULL) | (uint32_t)eval;
+		}
+	}
+
+	// permill of the probes since the last reset that were hits
+	int HitRate() const {
+		return probes ? (int)(hits * 1000 / probes) : 0;
+	}
+
+	void resetStats() {
+		probes = hits = 0;
+	}
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include "magic bitboard/Board.h"
+
+
+// hands out the moves of a position one at a time, the ones most likely to cut first. every stage is only
+// generated and scored once the ones before it failed, a node that cuts on the table move generates nothing
+// and the quiet moves wait until every capture and the killers were tried
+class MovePicker {
+public:
+	// for NegMax. the table move, killers and counter move come from other positions and are checked before they are played
+	MovePicker(const Board& board, Move ttMove, Move killer1, Move killer2, Move counter, const int history[12][64]);
+
+	// for quiescence, only the captures ordered by what they take
+	explicit MovePicker(const Board& board);
+
+	// an empty move once there is nothing left
+	Move Next();
+
+private:
+	enum Stage {
+		TT_MOVE,
+		GENERATE_CAPTURES,
+		GOOD_CAPTURES,
+		REFUTATIONS,
+		BAD_CAPTURES,
+		GENERATE_QUIETS,
+		QUIETS,
+		QS_GENERATE_CAPTURES,
+		QS_CAPTURES,
+		DONE
+	};
+
+	const Board& board;
+	const int (*history)[64];
+	int stage;
+
+	Move ttMove;
+	// the killers and the counter move, in the order they are tried
+	Move refutations[3];
+	int refutation;
+
+	// moves already handed out before their stage was generated, the generated lists skip them
+	Move tried[4];
+	int triedCount;
+
+	LegalMoves captures;
+	LegalMoves quiets;
+	// the scores of the list being picked from, each move is scored once when its stage is generated
+	int scores[256];
+	int current;
+	// captures that lose material are moved to the front of captures while the good ones are picked
+	int badCount;
+
+	Move pickBest(LegalMoves& list);
+	bool wasTried(Move move) const;
+
+	static int captureScore(Move move);
+};
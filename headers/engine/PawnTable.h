@@ -0,0 +1,32 @@
+#pragma once
+#include "magic bitboard/Board.h"
+
+#define PAWN_HASH_ENTRIES 16384
+
+// everything about a pawn structure that only depends on where the pawns are.
+// scores are from white's point of view
+struct PawnEntry {
+	uint64_t key;
+
+	int score;
+
+	// king safety of a king standing on a file, looked up once the king square is known
+	int8_t shelter[2][8];
+};
+
+// direct mapped cache of pawn structure terms, keyed by Board::pawnKey. pawn structures
+// change rarely during a search so almost every lookup is a hit.
+// not shared between threads, every engine owns its own
+struct PawnTable {
+	PawnTable() { clear(); }
+
+	void clear();
+
+	// pawn structure and king shelter, relative to the side to move like Board::eval
+	int Evaluate(const Board& board);
+
+private:
+	PawnEntry entries[PAWN_HASH_ENTRIES];
+
+	void compute(const Board& board, PawnEntry* entry) const;
+};
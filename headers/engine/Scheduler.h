@@ -0,0 +1,104 @@
+#pragma once
+#include "ChessEngine.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#ifndef WIN32
+#include <ucontext.h>
+#endif
+
+
+// one game of an engine farm. the engine and its heuristics live as long as the game,
+// every search of it is a request to the scheduler
+struct ScheduledGame {
+	ChessEngine engine;
+	Board board;
+
+	// the request, the budget is time the search actually runs and not time spent waiting for a thread
+	int depth;
+	int budgetMs;
+
+	// the result and what the search went through to get it, times are from GetTimeMs
+	Move bestMove;
+	int submitTime;
+	int firstRunTime;
+	int doneTime;
+	int64_t runUs;
+	int slices;
+
+	explicit ScheduledGame(std::shared_ptr<TTable> table) : engine(table), depth(100000), budgetMs(0),
+		submitTime(0), firstRunTime(0), doneTime(0), runUs(0), slices(0), running(false), finished(false),
+		stack(nullptr), switchTime(0), suspendedUs(0), searchStart(0) {
+		engine.silent = true;
+	}
+
+	~ScheduledGame();
+
+	ScheduledGame(const ScheduledGame&) = delete;
+	ScheduledGame& operator=(const ScheduledGame&) = delete;
+
+private:
+	friend class SearchScheduler;
+
+	std::function<void(ScheduledGame*)> done;
+	bool running;
+	bool finished;
+
+	// the search runs on a stack of its own so it can be left in the middle of NegMax and picked up later
+#ifndef WIN32
+	ucontext_t context;
+	ucontext_t* home;
+#endif
+	char* stack;
+
+	// when the search was last switched in while it runs, when it was switched out while it waits
+	int64_t switchTime;
+	int64_t suspendedUs;
+	int searchStart;
+};
+
+
+// runs any number of searches on a fixed set of threads. a search gives its thread up at the communicate
+// checkpoint once it had its slice, the thread then goes on with the next search it holds, round robin.
+// a search stays on the thread it started on until it finishes, only searches that didn't start yet
+// are handed out between threads
+class SearchScheduler {
+public:
+	SearchScheduler(int threads, int sliceMs = 2);
+	~SearchScheduler();
+
+	// searches game->board with the game's depth and budget, done is called on a scheduler thread
+	// once game->bestMove is there. it may submit the game again
+	void Submit(ScheduledGame* game, std::function<void(ScheduledGame*)> done);
+
+	// blocks until every submitted search, and the ones submitted from their done, finished
+	void WaitIdle();
+
+	int Threads() const { return threadCount; }
+
+	// times a search was left for another one
+	uint64_t Switches() const { return switches; }
+
+private:
+	const int threadCount;
+	const int64_t sliceUs;
+	std::vector<std::thread> threads;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<ScheduledGame*> pending;
+	// submitted and not done yet, pending ones included
+	int outstanding;
+	bool quit;
+
+	std::atomic<uint64_t> switches;
+
+	void work();
+	// runs the search until it finished or its slice is up
+	void resume(ScheduledGame* game);
+	void yield(ScheduledGame* game);
+	static void entry();
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include "magic bitboard/Board.h"
+#include <atomic>
+#include <thread>
 
 enum HashFlags {
 	HASH_EXSACT,
@@ -8,38 +10,125 @@ enum HashFlags {
 };
 
 
-
+// unpacked view of a table entry, this is what the search works with
 struct THash {
-	uint64_t key;
 	int depth;
 	HashFlags flag;
 	int score;
 	Move bestMove;
 };
 
+#define TT_CLUSTER_SIZE 8
+
+// counting is compiled in with the TT_STATS cmake option. the counters are only ever
+// bumped with a relaxed load and store, several threads may lose a few counts but never pay for a locked add
+#ifdef TT_STATS
+#define TT_STAT(counter) (counter).store((counter).load(std::memory_order_relaxed) + 1, std::memory_order_relaxed)
+#else
+#define TT_STAT(counter)
+#endif
+
+struct TTStats {
+	std::atomic<uint64_t> probes;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> cutoffs;
+	// a hit whose move isn't a move in the position, the 16 bit check let another position through
+	std::atomic<uint64_t> collisions;
+	std::atomic<uint64_t> writes;
+	// a write that threw out a deeper entry of another position
+	std::atomic<uint64_t> deeperOverwrites;
+
+	TTStats() { reset(); }
+
+	void reset() {
+		probes = hits = cutoffs = collisions = writes = deeperOverwrites = 0;
+	}
+};
+
+#define TT_GENERATION_MASK 0x3f
+
+// a whole entry is packed into one 64 bit word:
+// bits 0-15 low bits of the key, 16-31 move, 32-48 score, 49-55 depth, 56-57 flag, 58-63 generation
+// the table only ever loads and stores whole words, so threads sharing it can never see half of an entry
+struct TTEntry {
+	uint64_t data;
+
+	TTEntry(uint64_t _data = 0) : data(_data) {}
+
+	static constexpr int scoreBias = 1 << 16;
+
+	static uint64_t pack(uint16_t key16, Move move, int score, int depth, HashFlags flag, uint8_t generation) {
+		return (uint64_t)key16 |
+			((uint64_t)move.getPacked() << 16) |
+			((uint64_t)((score + scoreBias) & 0x1ffff) << 32) |
+			((uint64_t)(depth & 0x7f) << 49) |
+			((uint64_t)(flag & 0x3) << 56) |
+			((uint64_t)(generation & TT_GENERATION_MASK) << 58);
+	}
+
+	inline uint16_t key16() const { return data & 0xffff; }
+	// only the squares and flags of the move fit, not its piece. a known limitation: a promotion comes back out
+	// without the piece it promotes to, so a best move that underpromotes isn't reliably tried first again.
+	// underpromotions are rarely best
+	inline Move move() const { return Move((uint16_t)(data >> 16)); }
+	inline int score() const { return (int)((data >> 32) & 0x1ffff) - scoreBias; }
+	inline int depth() const { return (data >> 49) & 0x7f; }
+	inline HashFlags flag() const { return static_cast<HashFlags>((data >> 56) & 0x3); }
+	inline uint8_t generation() const { return (data >> 58) & TT_GENERATION_MASK; }
+
+	inline void setGeneration(uint8_t generation) {
+		data = (data & ~(uint64_t(TT_GENERATION_MASK) << 58)) | ((uint64_t)(generation & TT_GENERATION_MASK) << 58);
+	}
+};
+
+// one cache line worth of entries, a probe never touches more than one cluster
+struct alignas(64) TTCluster {
+	std::atomic<uint64_t> entries[TT_CLUSTER_SIZE];
+};
+
+static_assert(sizeof(TTCluster) == 64, "a cluster has to fill exactly one cache line");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "entries have to be plain 64 bit words");
+
+// the table is lock free, any number of engines can probe and write it at the same time
 struct TTable
 {
-	THash* hashTable;
+	TTCluster* clusters;
 
-	unsigned int size;
+	size_t clusterCount;
 
-	TTable(unsigned int _size) : size(_size), hashTable(0) {
-		hashTable = new THash[size];
+	uint8_t generation;
+
+	// how many threads zero the table, each one first touches its own slice of it
+	int clearThreads;
+
+	TTStats stats;
+
+	TTable(size_t mb, int _clearThreads = std::thread::hardware_concurrency())
+		: clusters(0), clusterCount(0), generation(0), clearThreads(_clearThreads), mappedBytes(0) {
+		Resize(mb);
 	}
 
 	~TTable() {
-		delete[] hashTable;
+		release();
 	}
 
-	void Resize(unsigned int newSize) {
-		delete[] hashTable;
+	TTable(const TTable&) = delete;
+	TTable& operator=(const TTable&) = delete;
 
-		size = newSize;
-		hashTable = new THash[size];
-	}
+	// size is in MiB, every byte of it goes to clusters. if the memory can't be had
+	// the size is halved until it can
+	void Resize(size_t mb);
+
+	void clear();
+
+	// dumps the table to a file, Load maps such a file back in as the table, replacing the
+	// current one and taking its size. files written with other zobrist keys are refused
+	bool Save(const std::string& path) const;
+	bool Load(const std::string& path);
 
-	void clear() {
-		std::fill((int*)(hashTable),(int*)(hashTable+size),0);
+	// called once per search so older entries lose their priority in the replacement scheme
+	void NewSearch() {
+		generation = (generation + 1) & TT_GENERATION_MASK;
 	}
 
 	bool ProbeHash(uint64_t key, THash* hashEntry, int ply);
@@ -47,4 +136,81 @@ struct TTable
 
 
 	void WriteHash(uint64_t key, int score, int depth, Move bestMove, HashFlags flag, int ply);
+
+	// starts pulling the cluster of a position into cache without waiting for it, meant to be
+	// issued as soon as a child key is known so the probe at the top of the child doesn't stall
+	inline void Prefetch(uint64_t key) const {
+#ifdef _MSC_VER
+		_mm_prefetch((const char*)&clusters[ClusterIndex(key)], _MM_HINT_T0);
+#else
+		__builtin_prefetch(&clusters[ClusterIndex(key)]);
+#endif
+	}
+
+	// permill of the first thousand entries that were written or hit by the current search, like uci wants it
+	int Hashfull() const;
+
+	// two keys with the same cluster index and low 16 bits look like the same position to the table.
+	// the index comes from the high bits of key * clusterCount, so any table size works without a modulo
+	inline size_t ClusterIndex(uint64_t key) const {
+#ifdef _MSC_VER
+		return __umulh(key, clusterCount);
+#else
+		return (size_t)(((unsigned __int128)key * clusterCount) >> 64);
+#endif
+	}
+
+private:
+	// bytes actually mapped, 0 when the clusters came from the regular heap
+	size_t mappedBytes;
+
+	bool allocate(size_t count);
+	void release();
+
+	inline TTCluster* cluster(uint64_t key) {
+		return &clusters[ClusterIndex(key)];
+	}
+
+	inline int age(const TTEntry& entry) const {
+		return (generation - entry.generation()) & TT_GENERATION_MASK;
+	}
+};
+
+
+// perft counts keyed by position and remaining depth. a slot is two words, the count and the key
+// xored with it, a slot torn by two threads writing it at once no longer matches its key and is
+// simply a miss. buckets have a slot that keeps the deepest count and one that is always replaced
+struct PerftEntry {
+	std::atomic<uint64_t> check;
+	std::atomic<uint64_t> data;
+};
+
+struct PerftTable
+{
+	PerftEntry* entries;
+
+	// always a power of two
+	size_t entryCount;
+
+	PerftTable(size_t mb);
+
+	~PerftTable() {
+		delete[] entries;
+	}
+
+	PerftTable(const PerftTable&) = delete;
+	PerftTable& operator=(const PerftTable&) = delete;
+
+	bool Probe(uint64_t key, int depth, uint64_t* nodes) const;
+	void Store(uint64_t key, int depth, uint64_t nodes);
+
+private:
+	// the same position at another depth has to be another key
+	static inline uint64_t depthKey(uint64_t key, int depth) {
+		return key ^ (0x9e3779b97f4a7c15ULL * (uint64_t)(depth + 1));
+	}
+
+	inline PerftEntry* bucket(uint64_t key) const {
+		return &entries[key & (entryCount - 1) & ~(size_t)1];
+	}
 };
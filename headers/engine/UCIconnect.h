@@ -1,4 +1,6 @@
 #include "ChessEngine.h"
+#include "Cluster.h"
+#include "Scheduler.h"
 #ifdef WIN32
 #include <windows.h>
 #endif
@@ -6,12 +8,27 @@
 
 class UCIconnection {
 public:
-	void Loop();
+	~UCIconnection() { stopSearch(); }
+
+	// a cluster worker only takes the commands a coordinator sends, nothing that touches files or runs benches
+	void Loop(bool worker = false);
 private:
 	void ParseGo(char* line);
+	// stops a running search and waits until it printed its bestmove
+	void stopSearch();
 	void bench(int depth);
+	void benchParallel(int depth, int threads, int hashMB);
+	void analyseEpd(char* args, int hashMB);
+	void farm(int games, int threads, int movetime, int plies, int hashMB);
+	void stressHash(int threads, int seconds);
+	void benchHash(int maxMB, int maxThreads);
+	void benchMoveGen(int passes);
 	Move ParseMove(const std::string& command);
 	void ParsePos(char* lineIn);
 	Board _board;
 	ChessEngine _engine;
+	std::thread _searchThread;
+	// workers the search is split over when the Cluster option is set, and the position they are sent
+	Cluster _cluster;
+	std::string _positionLine = "position startpos";
 };
\ No newline at end of file
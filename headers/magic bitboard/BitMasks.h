@@ -1,6 +1,11 @@
 #pragma once
 #include "misc.h"
 
+// msvc has no macro for bmi2 alone, it comes with avx2
+#if defined(USE_PEXT) && !defined(__BMI2__) && !defined(__AVX2__)
+#error "USE_PEXT needs a compiler targeting BMI2, build with -mbmi2 or /arch:AVX2"
+#endif
+
 int countBits(uint64_t);
 int getLSB(uint64_t value);
 void print_BitBoard(uint64_t BitBoards);
@@ -16,9 +21,44 @@ public:
     static uint64_t bishopMagic[64];
     static uint64_t rookMagic[64];
 
+    // 64 minus the relevant bits of the mask, so the magic lookup doesn't count them every time
+    static int bishopShift[64];
+    static int rookShift[64];
+
     static uint64_t bishopAttacks[64][512];
     static uint64_t rookAttacks[64][4096];
 
+    // where the blockers of a slider land in its attack table. pext packs the mask bits down in the same
+    // order setOccupancy spreads them out, the magics get there with a multiplication
+    static inline uint64_t bishopIndex(int square, uint64_t occupancy) {
+#ifdef USE_PEXT
+        return _pext_u64(occupancy, bishopMasks[square]);
+#else
+        return ((occupancy & bishopMasks[square]) * bishopMagic[square]) >> bishopShift[square];
+#endif
+    }
+
+    static inline uint64_t rookIndex(int square, uint64_t occupancy) {
+#ifdef USE_PEXT
+        return _pext_u64(occupancy, rookMasks[square]);
+#else
+        return ((occupancy & rookMasks[square]) * rookMagic[square]) >> rookShift[square];
+#endif
+    }
+
+    static inline uint64_t bishopAttacksFrom(int square, uint64_t occupancy) {
+        return bishopAttacks[square][bishopIndex(square, occupancy)];
+    }
+
+    static inline uint64_t rookAttacksFrom(int square, uint64_t occupancy) {
+        return rookAttacks[square][rookIndex(square, occupancy)];
+    }
+
+    // for two squares on a rank, file or diagonal, the squares strictly between them and the whole
+    // line through both from edge to edge. empty for squares that don't share a line
+    static uint64_t between[64][64];
+    static uint64_t line[64][64];
+
     static uint64_t pieceKeys[12][64];
     static uint64_t enPeasentKeys[64];
     static uint64_t CastleKeys[16];
@@ -36,11 +76,16 @@ public:
         generateBishopAttacks();
         generateRookAttacks();
 
+        generateLineBitmasks();
+
         generateHashKeys(); 
     }
 
     static void generateHashKeys();
 
+    // fingerprint of every zobrist key, anything keyed by hashes from another key set is meaningless
+    static uint64_t hashKeySignature();
+
     static void generateBishopBitmasks();
 
     static void generateKingBitmasks();
@@ -54,6 +99,8 @@ public:
 
     static void generateKnightBitmasks();
 
+    static void generateLineBitmasks();
+
     static void generateBishopMagicNumbers();
 
     static void generateRookMagicNumbers();
@@ -45,6 +45,10 @@ struct Move {
     Move() : m_Move(0) {
     }
 
+    // rebuilds a move from its low 16 bits (to, from, flags), see getPacked
+    explicit Move(uint16_t packed) : m_Move(packed) {
+    }
+
     Move(unsigned int from, unsigned int to, unsigned int flags, Color color, Piece piece, Piece captured ) {
         m_Move = (((static_cast<unsigned int>(captured) & 0x7) << 23) | (static_cast<unsigned int>(piece) & 0x7) << 20) | ((static_cast<unsigned int>(color) & 0x1) << 16) |
             ((flags & 0xf) << 12) | ((from & 0x3f) << 6) | (to & 0x3f);
@@ -65,6 +69,8 @@ struct Move {
 
     inline unsigned int getButterflyIndex() const { return m_Move & 0x0fff; }
 
+    inline uint16_t getPacked() const { return m_Move & 0xffff; }
+
     inline Color getColor() const { return static_cast<Color>((m_Move >> 16) & 0x1); }
     inline Piece getPiece() const { return static_cast<Piece>((m_Move >> 20) & 0x7); }
 
@@ -108,6 +114,11 @@ private:
     unsigned int m_Move;
 };
 
+// == compares the 16 bits a table keeps and leaves out the piece, promotions to different pieces are different moves here
+inline bool sameMove(Move a, Move b) {
+    return a == b && a.getPiece() == b.getPiece();
+}
+
 struct LegalMoves {
     int count;
     Move moves[256];
@@ -131,6 +142,26 @@ struct LegalMoves {
     }
 };
 
+// what a move of one side has to respect to be legal, worked out once per generated position
+struct MoveMasks {
+    // pieces giving check
+    uint64_t checkers;
+    // squares a move other than a king move has to end on. the checker and the squares between it
+    // and the king in check, nothing in double check
+    uint64_t checkMask;
+    // own pieces that would uncover an attack on the king if they left the line they are on
+    uint64_t pinned;
+    int king;
+
+    inline uint64_t targets(int from) const {
+        return checkMask & (((pinned >> from) & 1) ? Masks::line[king][from] : ~0ULL);
+    }
+
+    inline bool allows(int from, int to) const {
+        return (targets(from) >> to) & 1;
+    }
+};
+
 class Board {
 public:
     Board(const std::string& fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
@@ -140,7 +171,7 @@ public:
     void getBoard(int board[64]);
 
     bool isSquareOccupied(uint32_t square) const;
-    Piece getPiece(uint32_t square) const;
+    inline Piece getPiece(uint32_t square) const { return static_cast<Piece>(mailbox[square]); }
     void clearSquare(uint32_t square);
     void setSquare(uint32_t square, Color color, Piece piece);
 
@@ -152,13 +183,26 @@ public:
     void PrintBoard() const;
 
 
+    // both only generate legal moves, nothing has to be made to find out if a move leaves the king in check
     LegalMoves GenerateLegalMoves(Color color) const;
     LegalMoves GenerateCaptureMoves(Color color) const;
+    // every legal move GenerateCaptureMoves leaves out, castling and quiet promotions included
+    LegalMoves GenerateQuietMoves(Color color) const;
+
+    // the move as GenerateLegalMoves would give it for the side to move, or an empty move if it has no such move.
+    // only the squares and flags are looked at, a promotion is to a queen unless the move names another piece
+    Move LegalMove(Move move) const;
+
+    // true when the exchange the capture starts on its square wins at least threshold, pins are ignored
+    bool StaticExchange(Move move, int threshold = 0) const;
 
     bool isSqaureAttacked(Color color, int square) const;
     bool isKingAttacked(Color color) const;
 
     uint64_t generateHashKey() const;
+    uint64_t generatePawnKey() const;
+
+    uint64_t getPieces(Color color, Piece piece) const;
 
     Color currentPlayer;
 
@@ -166,6 +210,9 @@ public:
 
     uint64_t hashKey;
 
+    // zobrist key of the pawns alone, kept up to date by MakeMove like hashKey
+    uint64_t pawnKey;
+
     std::int8_t enPassantSquare;
 
 
@@ -186,6 +233,9 @@ private:
     uint64_t blackPieces;
     uint64_t whitePieces;
 
+    // the piece on every square, kept next to the bitboards by setSquare and clearSquare so a lookup is one load
+    std::uint8_t mailbox[64];
+
 
     uint8_t castleFlags;
 
@@ -204,20 +254,39 @@ private:
 
     bool isOccupiedByColor(std::int32_t square, Color color) const;
 
-    uint64_t generateSlidingMovesAsBits(std::int32_t square, uint64_t mask, uint64_t magic_number, const uint64_t attacks[4096], Piece piece) const;
-    uint64_t generateNonSlidingMovesAsBits(std::int32_t square, uint64_t mask, Piece piece) const;
     uint64_t generatePawnMovesAsBits(const Color color) const;
 
     uint64_t GetAttackedPieces(Color color) const;
 
+    // everything below is compiled once per side, the public functions pick the side once per call
+    // and the generators never ask which color they are working for again
+    template<Color Us> void makeMove(const Move& move);
+
+    template<Color Us> LegalMoves generateLegalMoves() const;
+    template<Color Us> LegalMoves generateCaptureMoves() const;
+    template<Color Us> LegalMoves generateQuietMoves() const;
+    template<Color Us> Move legalMove(Move move) const;
+
+    template<Color Us> bool isSquareAttacked(int square) const;
+
+    // pieces of the other side than Us that attack the square, sliders looking through the given occupancy
+    template<Color Us> uint64_t attackersTo(int square, uint64_t occupancy) const;
+    template<Color Us> MoveMasks getMoveMasks() const;
+    // the captured pawn and the capturing one leave the same rank at once, that can open a line to the king
+    template<Color Us> bool isEnPassantLegal(int from, const MoveMasks& masks) const;
+
 
-    inline void generatePawnMoves(const Color color, LegalMoves& legalMoves) const;
-    inline void generateNonSlidingMoves(std::int32_t square, LegalMoves& legalMoves, uint64_t mask, Piece piece) const;
-    inline void generateSlidingMoves(std::int32_t square, LegalMoves& legalMoves, uint64_t mask, uint64_t magic_number, uint64_t attacks[4096], Piece piece) const;
+    template<Color Us> inline void generatePawnMoves(LegalMoves& legalMoves, const MoveMasks& masks) const;
+    template<Color Us> inline void generatePawnPushes(LegalMoves& legalMoves, const MoveMasks& masks) const;
+    // the king moves to squares in allowed that aren't attacked, castling is separate
+    template<Color Us> inline void generateKingMoves(LegalMoves& legalMoves, uint64_t allowed) const;
+    template<Color Us> inline void generateCastleMoves(LegalMoves& legalMoves, const MoveMasks& masks) const;
+    template<Color Us> inline void generateNonSlidingMoves(std::int32_t square, LegalMoves& legalMoves, uint64_t mask, Piece piece) const;
+    template<Color Us> inline void generateSlidingMoves(std::int32_t square, LegalMoves& legalMoves, uint64_t attacks, Piece piece, uint64_t allowed) const;
 
-    inline void generatePawnAttacks(const Color color, LegalMoves& legalMoves) const;
-    inline void generateNonSlidingAttacks(const std::int32_t square, LegalMoves& legalMoves, uint64_t mask, Piece piece) const;
-    inline void generateSlidingAttacks(std::int32_t square, LegalMoves& legalMoves, uint64_t mask, uint64_t magic_number, uint64_t attacks[4096], Piece piece) const;
+    template<Color Us> inline void generatePawnAttacks(LegalMoves& legalMoves, const MoveMasks& masks) const;
+    template<Color Us> inline void generateNonSlidingAttacks(const std::int32_t square, LegalMoves& legalMoves, uint64_t mask, Piece piece) const;
+    template<Color Us> inline void generateSlidingAttacks(std::int32_t square, LegalMoves& legalMoves, uint64_t attacks, Piece piece, uint64_t allowed) const;
 
 
 
@@ -14,9 +14,21 @@
 
 #define valWINDOW 50
 
-#define HASH_SIZE 2000000
+#define HASH_SIZE 64
 
-#define HASH_MAX 100
+#define HASH_MAX 1048576
+
+#define EVAL_CACHE_SIZE 0
+
+#define EVAL_CACHE_MAX 1024
+
+#define THREADS_MAX 256
+
+#define MULTIPV_MAX 64
+
+#define YIELD_NODES 256
+
+#define CHECK_NODES 2048
 
 
 #include <cstdint>
@@ -1,9 +1,14 @@
 ﻿#include "engine/UCIconnect.h"
 
-int main()
+int main(int argc, char* argv[])
 {
     Masks::initBitmasks();
 
+    // GrandChessUCI listen <address> runs as a worker of a cluster, see Cluster.h
+    if (argc > 2 && !strcmp(argv[1], "listen")) {
+        return Cluster::Listen(argv[2]) ? 0 : 1;
+    }
+
     UCIconnection connection;
 
     connection.Loop();
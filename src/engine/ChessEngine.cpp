@@ -1,28 +1,53 @@
 #include "engine/ChessEngine.h"
+#include "engine/MovePicker.h"
+#include <limits>
 
 
 
 
 
 void ChessEngine::communicate() {
-    if (GetTimeMs() - startTime >= maxTime) {
+    if (count < nextCheck) {
+        return;
+    }
+    nextCheck = count + CHECK_NODES;
+    sharedCount.store(count, std::memory_order_relaxed);
+
+    if (!ponder && GetTimeMs() - startTime >= maxTime) {
         stop = true;
     }
+
+    if (maxNodes) {
+        const int64_t nodes = NodesSearched();
+        if (nodes >= maxNodes) {
+            stop = true;
+        }
+        // the next check lands on the budget instead of up to CHECK_NODES past it
+        nextCheck = count + std::min<int64_t>(CHECK_NODES, std::max<int64_t>(maxNodes - nodes, 1));
+    }
+}
+
+
+void ChessEngine::checkpoint() {
+    if (count >= nextYield) {
+        nextYield = count + YIELD_NODES;
+        yield();
+    }
 }
 
 
 
 
-//this is needed becuase the value of the piece enum is used for rendering too
-constexpr static int translator[6] =
-{
-    5,
-    6,
-    4,
-    2,
-    3,
-    1
-};
+int ChessEngine::MateMoves(int score, int depth) {
+    // a mate scores MATE_VALUE plus the depth that was left where it happened, which gives the plies to it
+    if (score > MATE_SCORE) {
+        return std::max(1, (depth - (score - MATE_VALUE) + 1) / 2);
+    }
+    if (score < -MATE_SCORE) {
+        return -std::max(1, (depth - (-score - MATE_VALUE) + 1) / 2);
+    }
+    return 0;
+}
 
 
 bool ChessEngine::IsRepetition(uint64_t hash) {
@@ -34,44 +59,27 @@ bool ChessEngine::IsRepetition(uint64_t hash) {
     return false;
 }
 
-int ChessEngine::score_move(Move move) {
-
-    if (move == pv_table[0][ply]) {
-        return 100000;
-    }
-    if (move.getCapturedPiece() != EMPTY) {
-        // Compare capture moves
-        //translator is just a shortcut i use cuz  i use the vaalue of the piece enum for rendering too, just treat it as the pieces ordered by value
-        return (6 - translator[move.getPiece() - 1]) + (translator[move.getCapturedPiece() - 1]) * 100 + 10000;
+int ChessEngine::evaluate(const Board& board) {
+    int eval;
+    if (evalCache.Probe(board.hashKey, &eval)) {
+        return eval;
     }
-    else {
 
-
-        if (killer_moves[0][ply] == move) {
-            return 9000;
-        }
-
-        if (killer_moves[1][ply] == move) {
-            return 8000;
-        }
-
-        return history_moves[(move.getPiece() - 1) * (move.getColor() + 1)][move.getTo()];
-
-    }
-}
-
-
-
-
-inline bool ChessEngine::compareMoves(Move moveA, Move moveB) {
-    return score_move(moveA) > score_move(moveB);
+    eval = board.eval + pawnTable.Evaluate(board);
+    evalCache.Store(board.hashKey, eval);
+    return eval;
 }
 
 
 int ChessEngine::quiescence(const Board& board, int alpha, int beta) {
     count++;
+    communicate();
 
-    int standPat = board.eval; // Evaluate the current position without considering captures or promotions
+    if (yield) {
+        checkpoint();
+    }
+
+    int standPat = evaluate(board); // Evaluate the current position without considering captures or promotions
     int movesSearched = 0;
 
     if (standPat >= beta)
@@ -82,48 +90,12 @@ int ChessEngine::quiescence(const Board& board, int alpha, int beta) {
 
     alpha = std::max(alpha, standPat); // Update alpha with the maximum value between alpha and standPat for the maximizing player
 
-    LegalMoves captures = board.GenerateCaptureMoves(board.currentPlayer); // Generate all capture moves
-
-    for (int i = 0; i < captures.count; i++) {
-
-        int minIndex = i;
-        for (int j = i + 1; j < captures.count; j++) {
-            if (compareMoves(captures.moves[j], captures.moves[minIndex])) {
-                minIndex = j;
-            }
-        }
-        if (minIndex != i) {
-            std::swap(captures.moves[i], captures.moves[minIndex]);
-        }
+    MovePicker picker(board); // the capture moves, best first
 
+    for (Move move = picker.Next(); move != Move(); move = picker.Next()) {
 
         Board newboard = board;
-        newboard.MakeMove(captures.moves[i]);
-
-        if ((newboard.isKingAttacked(board.currentPlayer))) {
-            // Move doesn't result in own king being in check
-            continue;
-        }    
-
-
-        if (captures.moves[i].getFlags() == QUEEN_CASTLE || captures.moves[i].getFlags() == KING_CASTLE) {
-
-            // Get the starting and ending positions for the castle move
-            const int startPos = captures.moves[i].getFrom();
-            const int endPos = captures.moves[i].getTo();
-
-            // Check the squares between the starting and ending positions
-            const int minPos = std::min(startPos, endPos);
-            const int maxPos = std::max(startPos, endPos);
-
-            // Iterate over the squares between the starting and ending positions
-            for (int square = minPos; square < maxPos; square++) {
-                if (board.isSqaureAttacked(board.currentPlayer, square)) {
-                    // Square is attacked, so it is not safe to castle
-                    goto skipPlay;
-                }
-            }
-        }
+        newboard.MakeMove(move);
 
         if (stop) {
             return STOPPED;
@@ -144,8 +116,6 @@ int ChessEngine::quiescence(const Board& board, int alpha, int beta) {
         if (score >= beta) {
             return beta; // Perform a cutoff if alpha is greater than or equal to beta
         }
-
-    skipPlay:;
     }
 
 
@@ -158,8 +128,12 @@ const int fmargin[4] = { 0, 200, 300, 700 };
 int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
     pv_length[ply] = ply;
 
-    if (count % 2048) {
-        communicate();
+    const Move previous = ply ? lastMove : Move();
+
+    communicate();
+
+    if (yield) {
+        checkpoint();
     }
 
     if (ply && IsRepetition(board.hashKey))
@@ -191,19 +165,22 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
     bool isPv = (beta - alpha > 1);
 
 
-    bool wasHit = Table.ProbeHash(board.hashKey, &entry, ply);
+    bool wasHit = Table->ProbeHash(board.hashKey, &entry, ply);
     if (wasHit) {
         bestMove = entry.bestMove;
         if (!isPv && entry.depth >= depth)
         {
             score = entry.score;
             if (entry.flag == HASH_EXSACT) {
+                TT_STAT(Table->stats.cutoffs);
                 return score;
             }
             if (entry.flag == HASH_ALPHA && score <= alpha) {
+                TT_STAT(Table->stats.cutoffs);
                 return alpha;
             }
             if (entry.flag == HASH_BETA && score >= beta) {
+                TT_STAT(Table->stats.cutoffs);
                 return beta;
             }
         }
@@ -219,7 +196,7 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
     if (!in_check && ply && !isPv) {
 
         if (!wasHit) {
-            score = board.eval;
+            score = evaluate(board);
         }
 
         if (depth <= 5 && score >= beta && score - (depth * depth * 20) >= beta)
@@ -230,10 +207,12 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
         Board nullBoard = board;
 
         nullBoard.MakeNullMove();
+        Table->Prefetch(nullBoard.hashKey);
 
         char R = 2;
 
         ply += R + 1;
+        lastMove = Move();
         int score = -NegMax(depth - 1 - R, nullBoard, -beta, -beta + 1);
         ply -= R + 1;
 
@@ -244,55 +223,35 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
 
 
 
-    LegalMoves moves = board.GenerateLegalMoves(board.currentPlayer);
+#ifdef TT_STATS
+    if (wasHit && entry.bestMove != Move() && board.LegalMove(entry.bestMove) == Move()) {
+        TT_STAT(Table->stats.collisions);
+    }
+#endif
 
+    Move& counter = counter_moves[previous.getColor() * 6 + std::max<int>(previous.getPiece(), 1) - 1][previous.getTo()];
 
+    // without a table move the line of the last iteration still knows where to start
+    MovePicker picker(board, bestMove != Move() ? bestMove : pv_table[0][ply], killer_moves[0][ply], killer_moves[1][ply], previous != Move() ? counter : Move(), history_moves);
 
-    for (int i = 0; i < moves.count; i++) {
+    for (Move move = picker.Next(); move != Move(); move = picker.Next()) {
 
-        int minIndex = i;
-        for (int j = i + 1; j < moves.count; j++) {
-            if (moves.moves[j] == bestMove || (compareMoves(moves.moves[j], moves.moves[minIndex]) && moves.moves[minIndex] != bestMove)) {
-                minIndex = j;
-            }
+        if (ply == 0 && std::any_of(excludedMoves, excludedMoves + excludedCount, [move](Move excluded) { return sameMove(excluded, move); })) {
+            continue;
         }
-        if (minIndex != i) {
-            std::swap(moves.moves[i], moves.moves[minIndex]);
+        if (ply == 0 && searchMoves.count && std::none_of(searchMoves.moves, searchMoves.moves + searchMoves.count, [move](Move allowed) { return sameMove(allowed, move); })) {
+            continue;
         }
 
-
         Board newboard = board;
-        newboard.MakeMove(moves.moves[i]);
-
-        if ((newboard.isKingAttacked(board.currentPlayer))) {
-            // Move doesn't result in own king being in check
-            goto skipPlay;
-        }
-
-        if (moves.moves[i].getFlags() == QUEEN_CASTLE || moves.moves[i].getFlags() == KING_CASTLE) {
-
-            if (board.isKingAttacked(board.currentPlayer)) {
-                goto skipPlay;
-            }
+        newboard.MakeMove(move);
 
-            // Get the starting and ending positions for the castle move
-            const int startPos = moves.moves[i].getFrom();
-            const int endPos = moves.moves[i].getTo();
-
-            // Check the squares between the starting and ending positions
-            const int minPos = std::min(startPos, endPos);
-            const int maxPos = std::max(startPos, endPos);
-
-            // Iterate over the squares between the starting and ending positions
-            for (int square = minPos; square < maxPos; square++) {
-                if (newboard.isSqaureAttacked(board.currentPlayer, square)) {
-                    // Square is attacked, so it is not safe to castle
-                    goto skipPlay;
-                }
-            }
+        // children at depth 1 go straight to quiescence, which never probes the table
+        if (depth > 1) {
+            Table->Prefetch(newboard.hashKey);
         }
 
-        if (IsPrunable && movesSearched && moves.moves[i].getFlags() < 4 && !newboard.isKingAttacked(newboard.currentPlayer) && newboard.eval + fmargin[depth] <= alpha) {
+        if (IsPrunable && movesSearched && move.getFlags() < 4 && !newboard.isKingAttacked(newboard.currentPlayer) && newboard.eval + fmargin[depth] <= alpha) {
             goto skipPlay;
         }
 
@@ -304,15 +263,17 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
             ply++;
             repetitionIndex++;
             repetitionTable[repetitionIndex] = newboard.hashKey;
+            lastMove = move;
             score = -NegMax(depth - 1, newboard, -beta, -alpha);
             ply--;
             repetitionIndex--;
         }
         else {
-            if (movesSearched >= fullDepthMoves && depth >= reductionLimits && !in_check && moves.moves[i].getFlags() < 4) {
+            if (movesSearched >= fullDepthMoves && depth >= reductionLimits && !in_check && move.getFlags() < 4) {
                 ply += 2;
                 repetitionIndex += 2;
                 repetitionTable[repetitionIndex] = newboard.hashKey;
+                lastMove = move;
                 score = -NegMax(depth - 2, newboard, -alpha - 1, -alpha);
                 ply -= 2;
                 repetitionIndex -= 2;
@@ -326,6 +287,7 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
                 ply++;
                 repetitionIndex++;
                 repetitionTable[repetitionIndex] = newboard.hashKey;
+                lastMove = move;
                 score = -NegMax(depth - 1, newboard, -beta, -alpha);
                 ply--;
                 repetitionIndex--;
@@ -341,10 +303,10 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
         if (score > alpha) {
             hashFlag = HASH_EXSACT;
 
-            if (moves.moves[i].getCapturedPiece() == EMPTY) {
-                history_moves[(moves.moves[i].getPiece() - 1) * (moves.moves[i].getColor() + 1)][moves.moves[i].getTo()] += depth;
+            if (move.getCapturedPiece() == EMPTY) {
+                history_moves[(move.getPiece() - 1) * (move.getColor() + 1)][move.getTo()] += depth;
             }
-            pv_table[ply][ply] = moves.moves[i];
+            pv_table[ply][ply] = move;
 
             for (int next_ply = ply + 1; next_ply < pv_length[ply + 1]; next_ply++) {
                 pv_table[ply][next_ply] = pv_table[ply + 1][next_ply];
@@ -353,14 +315,19 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
             pv_length[ply] = pv_length[ply + 1];
 
             alpha = score;
-            bestMove = moves.moves[i];
+            bestMove = move;
         }
 
         if (score >= beta) {
-            Table.WriteHash(board.hashKey, score, depth, bestMove, HASH_BETA, ply);
-            if (moves.moves[i].getCapturedPiece() == EMPTY) {
+            if (ply || (!excludedCount && !searchMoves.count)) {
+                Table->WriteHash(board.hashKey, score, depth, bestMove, HASH_BETA, ply);
+            }
+            if (move.getCapturedPiece() == EMPTY) {
                 killer_moves[1][ply] = killer_moves[0][ply];
-                killer_moves[0][ply] = moves.moves[i];
+                killer_moves[0][ply] = move;
+                if (previous != Move()) {
+                    counter = move;
+                }
             }
             return beta;
         }
@@ -373,7 +340,10 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
         score = in_check * -(MATE_VALUE + depth);
     }
 
-    Table.WriteHash(board.hashKey, score, depth, bestMove, hashFlag, ply);
+    // a root searched without some of its moves, left out by multipv or searchmoves, has no score of its own
+    if (ply || (!excludedCount && !searchMoves.count)) {
+        Table->WriteHash(board.hashKey, score, depth, bestMove, hashFlag, ply);
+    }
 
     return alpha;
 }
@@ -381,55 +351,227 @@ int ChessEngine::NegMax(int depth, const Board& board, int alpha, int beta) {
 Move ChessEngine::BestMove(int maxDepth, const Board& board) {
     auto moves = board.GenerateLegalMoves(board.currentPlayer);
     if (moves.count == 0) {
-        // Handle the case where no legal moves are available
-        Move empty;
-        return empty; // Return an empty move
+        // mated or stalemated, the gui still waits for a bestmove. a pondering one only after stop or ponderhit
+        while (ponder && !stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!silent) {
+            printf("\nbestmove 0000\n");
+        }
+        stop = false;
+        ponder = false;
+        return Move();
+    }
+    // a search that only ends on stop or ponderhit must still stop deepening where the ply tables end
+    maxDepth = std::min(maxDepth, max_ply - 1);
+    ageTables();
+    Table->NewSearch();
+#ifdef TT_STATS
+    Table->stats.reset();
+#endif
+    evalCache.resetStats();
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < helpers.size(); i++) {
+        ChessEngine* helper = helpers[i].get();
+
+        // only the main thread watches the clock, it stops the helpers when it is done
+        helper->startTime = startTime;
+        helper->maxTime = std::numeric_limits<double>::infinity();
+        helper->maxNodes = 0;
+        helper->searchMoves = searchMoves;
+        helper->offset = offset;
+        helper->repetitionIndex = repetitionIndex;
+        memcpy(helper->repetitionTable, repetitionTable, sizeof(repetitionTable));
+        helper->ageTables();
+        helper->evalCache.resetStats();
+        helper->stop = false;
+
+        // every other helper starts a ply deeper so the threads spread over more than one depth
+        const int firstDepth = 1 + (i % 2 == 0);
+        workers.emplace_back([helper, maxDepth, &board, firstDepth] { helper->iterate(maxDepth, board, firstDepth, false); });
+    }
+
+    iterate(maxDepth, board, 1, true);
+
+    // the helpers go on filling the table until the gui wants the move
+    while (ponder && !stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-    clearTables();
+
+    for (auto& helper : helpers) {
+        helper->stop = true;
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    Move best = vote();
+
+    // stopped before any thread finished its first depth. the table move or else any legal move still beats none
+    if (best == Move()) {
+        best = moves.moves[0];
+
+        THash entry;
+        if (Table->ProbeHash(board.hashKey, &entry, 0)) {
+            for (int i = 0; i < moves.count; i++) {
+                if (moves.moves[i] == entry.bestMove) {
+                    best = moves.moves[i];
+                    break;
+                }
+            }
+        }
+    }
+
+#ifdef TT_STATS
+    const TTStats& stats = Table->stats;
+    if (!silent) {
+        printf("info string tt probes %llu hits %llu (%.1f%%) cutoffs %llu collisions %llu writes %llu deeper-overwrites %llu\n",
+            (unsigned long long)stats.probes, (unsigned long long)stats.hits, 100.0 * stats.hits / std::max<uint64_t>(stats.probes, 1),
+            (unsigned long long)stats.cutoffs, (unsigned long long)stats.collisions, (unsigned long long)stats.writes,
+            (unsigned long long)stats.deeperOverwrites);
+    }
+#endif
+
+    if (!silent) {
+        const Move reply = ponderMove(board, best);
+        if (reply != Move()) {
+            printf("\nbestmove %s ponder %s\n", best.to_str().c_str(), reply.to_str().c_str());
+        }
+        else {
+            printf("\nbestmove %s\n", best.to_str().c_str());
+        }
+    }
+
+    // cleared when the search is over instead of when it starts, a stop that comes in before
+    // the search thread got going would be lost otherwise
+    stop = false;
+    ponder = false;
+    return best;
+}
+
+
+Move ChessEngine::ponderMove(const Board& board, Move best) {
+    if (best == Move()) {
+        return Move();
+    }
+
+    Board child = board;
+    child.MakeMove(best);
+
+    Move reply = BestLineLength > 1 ? BestLine[1] : Move();
+
+    // a line cut short by a table hit still has the reply in the table
+    THash entry;
+    if (reply == Move() && Table->ProbeHash(child.hashKey, &entry, 0)) {
+        reply = entry.bestMove;
+    }
+
+    if (reply == Move()) {
+        return Move();
+    }
+
+    // only the low bits of a table move are known, and a collision could hand us a move of another position.
+    // LegalMove fills in the rest or gives back an empty move
+    return child.LegalMove(reply);
+}
 
 
+void ChessEngine::iterate(int maxDepth, const Board& board, int firstDepth, bool isMain) {
     int currentScore = 0;
     int alpha = MIN_SCORE;
     int beta = MAX_SCORE;
 
-    stop = false;
+    completedDepth = 0;
+    rootLineCount = 0;
+    rootLines[0].length = 0;
+    rootLines[0].moves[0] = Move();
+
+    // helpers only ever look for the best move
+    const int lines = isMain ? multiPV : 1;
+
+    for (int i = firstDepth; currentScore < MATE_SCORE && currentScore > -MATE_SCORE && i <= maxDepth; i++) {
+        int found = 0;
+
+        // one pass per line, every pass leaves out the root moves the passes before it found.
+        // the table, killers and history carry over from pass to pass
+        for (; found < lines; found++) {
+            ply = 0;
+            excludedCount = found;
+
+            // every line is ordered by its own pv from the last depth
+            if (found < rootLineCount) {
+                std::copy_n(rootLines[found].moves, rootLines[found].length, pv_table[0]);
+            }
+
+            int score;
+            if (found == 0) {
+                score = NegMax(i, board, alpha, beta);
+            }
+            else {
+                // the other lines get a window around their last score, searched again in full when they leave it
+                const int lineAlpha = found < rootLineCount ? rootLines[found].score - valWINDOW : MIN_SCORE;
+                const int lineBeta = found < rootLineCount ? rootLines[found].score + valWINDOW : MAX_SCORE;
+
+                score = NegMax(i, board, lineAlpha, lineBeta);
+                if (!stop && (score <= lineAlpha || score >= lineBeta)) {
+                    ply = 0;
+                    score = NegMax(i, board, MIN_SCORE, MAX_SCORE);
+                }
+            }
 
-    int length = 0;
-    for (int i = 1; currentScore < MATE_SCORE && currentScore > -MATE_SCORE && i <= maxDepth; i++) {
-        ply = 0;
+            if (stop || (found && pv_length[0] == 0)) {
+                break;
+            }
 
-        currentScore = NegMax(i, board, alpha, beta);
+            // a first pass that failed low has no pv, the line of the last depth stays with the new bound
+            rootLines[found].score = score;
+            if (pv_length[0]) {
+                rootLines[found].length = pv_length[0];
+                std::copy_n(pv_table[0], pv_length[0], rootLines[found].moves);
+            }
+            excludedMoves[found] = rootLines[found].moves[0];
+        }
 
+        excludedCount = 0;
 
         if (stop) {
             break;
         }
 
+        rootLineCount = found;
+        std::stable_sort(rootLines, rootLines + rootLineCount, [](const RootLine& a, const RootLine& b) { return a.score > b.score; });
 
+        currentScore = rootLines[0].score;
 
-        memcpy(BestLine, pv_table[0], sizeof(Move)*pv_length[0]);
-        length = pv_length[0];
+        std::copy_n(rootLines[0].moves, rootLines[0].length, BestLine);
+        BestLineLength = rootLines[0].length;
 
+        completedDepth = i;
+        bestScore = currentScore;
 
-        int timediff = GetTimeMs() - startTime;
+        if (isMain && !silent) {
+            const int64_t nodes = NodesSearched();
+            int timediff = GetTimeMs() - startTime;
 
-        if (currentScore > MATE_SCORE) {
-            printf("info score mate %d depth %d nodes %d time %d nps %d pv ", -(currentScore+MATE_VALUE)/2 - 1, i, count, timediff,count/ (timediff == 0 ? 1 : timediff) *1000);
+            for (int k = 0; k < rootLineCount; k++) {
+                const int lineScore = rootLines[k].score;
+                const int mate = MateMoves(lineScore, i);
 
-        }
-        else if (currentScore < -MATE_SCORE)
-        {
-            printf("info score mate %d depth %d nodes %d time %d nps %d pv ", (MATE_VALUE - currentScore)/2 + 1, i, count, GetTimeMs() - startTime, count / (timediff == 0 ? 1 : timediff) * 1000);
+                if (mate) {
+                    printf("info multipv %d score mate %d depth %d nodes %lld time %d nps %lld hashfull %d pv ", k + 1, mate, i, (long long)nodes, timediff, (long long)(nodes / (timediff == 0 ? 1 : timediff) * 1000), Table->Hashfull());
+                }
+                else {
+                    printf("info multipv %d score cp %d depth %d nodes %lld time %d nps %lld hashfull %d pv ", k + 1, lineScore, i, (long long)nodes, timediff, (long long)(nodes / (timediff == 0 ? 1 : timediff) * 1000), Table->Hashfull());
+                }
 
-        }
-        else {
-            printf("info score cp %d depth %d nodes %d time %d nps %d pv ", currentScore, i, count, GetTimeMs() - startTime, count / (timediff == 0 ? 1 : timediff) * 1000);
+                for (int j = 0; j < rootLines[k].length; j++) {
+                    printf("%s ", rootLines[k].moves[j].to_str().c_str());
+                }
+                printf("\n");
+            }
         }
 
-        for (int j = 0; j < length; j++) {
-            printf("%s ", BestLine[j].to_str().c_str());
-        }
-        printf("\n");
         if (currentScore <= alpha || currentScore >= beta) {
             alpha = MIN_SCORE;
             beta = MAX_SCORE;
@@ -443,63 +585,247 @@ Move ChessEngine::BestMove(int maxDepth, const Board& board) {
         beta = currentScore + valWINDOW;
     }
 
-    printf("\nbestmove %s\n", BestLine[0].to_str().c_str());
+    sharedCount.store(count, std::memory_order_relaxed);
+}
+
+
+// every thread that finished a depth votes for its move, deeper and better scoring results weigh more.
+// the main engine takes over the winning line so the next search starts from it
+Move ChessEngine::vote() {
+    // the lines shown for multipv are the main thread's, its move has to match them
+    if (multiPV > 1) {
+        return completedDepth ? BestLine[0] : Move();
+    }
+
+    std::vector<ChessEngine*> threads = { this };
+    for (auto& helper : helpers) {
+        if (helper->completedDepth && helper->BestLineLength) {
+            threads.push_back(helper.get());
+        }
+    }
+
+    int minScore = bestScore;
+    for (ChessEngine* thread : threads) {
+        minScore = std::min(minScore, thread->bestScore);
+    }
+
+    auto votes = [&](Move move) {
+        int64_t total = 0;
+        for (ChessEngine* thread : threads) {
+            if (thread->BestLine[0] == move) {
+                total += (int64_t)(thread->bestScore - minScore + 14) * thread->completedDepth;
+            }
+        }
+        return total;
+    };
+
+    ChessEngine* best = this;
+    int64_t bestVotes = completedDepth && BestLineLength ? votes(BestLine[0]) : -1;
+
+    for (ChessEngine* thread : threads) {
+        const int64_t threadVotes = votes(thread->BestLine[0]);
+        if (threadVotes > bestVotes || (threadVotes == bestVotes && thread->completedDepth > best->completedDepth)) {
+            best = thread;
+            bestVotes = threadVotes;
+        }
+    }
+
+    // no thread got through a depth, the line left over is from an earlier search
+    if (!best->completedDepth) {
+        return Move();
+    }
+
+    if (best != this) {
+        std::copy_n(best->BestLine, best->BestLineLength, BestLine);
+        BestLineLength = best->BestLineLength;
+    }
+
     return BestLine[0];
 }
 
 
-int ChessEngine::Perft(int depth, const Board& board) {
+void ChessEngine::SetThreads(int threads) {
+    const size_t evalCacheMB = (evalCache.entryCount * sizeof(uint64_t)) >> 20;
+
+    helpers.clear();
+    for (int i = 1; i < threads; i++) {
+        helpers.push_back(std::make_unique<ChessEngine>(Table));
+        helpers.back()->ResizeEvalCache(evalCacheMB);
+    }
+}
+
+
+void ChessEngine::Stop() {
+    stop = true;
+    for (auto& helper : helpers) {
+        helper->stop = true;
+    }
+}
+
+
+void ChessEngine::ResizeEvalCache(size_t mb) {
+    evalCache.Resize(mb);
+    for (auto& helper : helpers) {
+        helper->evalCache.Resize(mb);
+    }
+}
+
+
+int64_t ChessEngine::NodesSearched() const {
+    int64_t nodes = count;
+    for (auto& helper : helpers) {
+        nodes += helper->sharedCount.load(std::memory_order_relaxed);
+    }
+    return nodes;
+}
+
+
+uint64_t ChessEngine::Perft(int depth, const Board& board, PerftTable* table) {
     if (depth == 0) {
         return 1; // Leaf node, return 1
     }
 
-    int nodes = 0;
+    uint64_t nodes = 0;
+
+    // a subtree of one ply is counted faster than it is looked up
+    if (table && depth > 1 && table->Probe(board.hashKey, depth, &nodes)) {
+        return nodes;
+    }
 
     auto moves = board.GenerateLegalMoves(board.currentPlayer);
 
+    // the moves are legal, the last ply is just their count
+    if (depth == 1) {
+        return moves.count;
+    }
+
     for (int i = 0; i < moves.count; i++) {
         Board newboard = board;
         newboard.MakeMove(moves.moves[i]);
 
-        if ((newboard.isKingAttacked(board.currentPlayer))) {
-            // Move doesn't result in own king being in check
+        nodes += Perft(depth - 1, newboard, table);
+    }
+
+    if (table && depth > 1) {
+        table->Store(board.hashKey, depth, nodes);
+    }
+
+    return nodes;
+}
+
+
+void ChessEngine::RunPerftTest(int depth, const Board& board, int threads, size_t hashMB) {
+    auto start = GetTimeMs();
+
+    // one table for all threads, it is only allocated for this run
+    std::unique_ptr<PerftTable> table(hashMB ? new PerftTable(hashMB) : nullptr);
+
+    // the tree is cut into the subtrees two plies down so there are a few hundred jobs
+    // and a thread that got a small one just takes the next
+    struct PerftJob {
+        int root;
+        Board board;
+        uint64_t nodes;
+    };
+
+    std::vector<Move> rootMoves;
+    std::vector<PerftJob> jobs;
+
+    auto moves = board.GenerateLegalMoves(board.currentPlayer);
+    for (int i = 0; i < moves.count; i++) {
+        Board newboard = board;
+        newboard.MakeMove(moves.moves[i]);
+
+        if (depth == 0) {
             continue;
+        }
 
+        const int root = (int)rootMoves.size();
+        rootMoves.push_back(moves.moves[i]);
+
+        if (depth < 3) {
+            jobs.push_back({ root, newboard, 0 });
+            continue;
         }
 
-        if (moves.moves[i].getFlags() == QUEEN_CASTLE || moves.moves[i].getFlags() == KING_CASTLE) {
-            if (board.isKingAttacked(board.currentPlayer)) {
-                continue;
-            }
+        auto replies = newboard.GenerateLegalMoves(newboard.currentPlayer);
+        for (int j = 0; j < replies.count; j++) {
+            Board reply = newboard;
+            reply.MakeMove(replies.moves[j]);
 
+            jobs.push_back({ root, reply, 0 });
         }
+    }
+
+    const int jobDepth = depth < 3 ? depth - 1 : depth - 2;
+    std::atomic<size_t> nextJob(0);
+
+    auto work = [&]() {
+        for (size_t job = nextJob++; job < jobs.size(); job = nextJob++) {
+            jobs[job].nodes = Perft(jobDepth, jobs[job].board, table.get());
+        }
+    };
 
-        // Recursively count the number of nodes at the next depth
-        nodes += Perft(depth - 1, newboard);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(work);
     }
+    work();
 
-    return nodes;
-}
+    for (auto& worker : workers) {
+        worker.join();
+    }
 
-void ChessEngine::RunPerftTest(int depth, const Board& board) {
-    auto start = GetTimeMs();
+    std::vector<uint64_t> divide(rootMoves.size(), 0);
+    uint64_t nodes = depth == 0;
+    for (const PerftJob& job : jobs) {
+        divide[job.root] += job.nodes;
+        nodes += job.nodes;
+    }
 
-    int nodes = Perft(depth, board);
+    double totaltime = GetTimeMs() - start;
 
-    double totaltime = GetTimeMs()-start;
+    for (size_t i = 0; i < rootMoves.size(); i++) {
+        std::cout << rootMoves[i].to_str() << ": " << divide[i] << "\n";
+    }
     std::cout << "Perft Test Results:\n";
+    std::cout << "threads: " << threads << "\n";
+    std::cout << "hash: " << hashMB << " MB\n";
     std::cout << "time: " << totaltime << std::endl;
     std::cout << "Nodes: " << (nodes ) << "\n";
-    std::cout << "NPS: " << (nodes)/ totaltime << "\n";
+    std::cout << "NPS: " << (uint64_t)(nodes * 1000 / std::max(totaltime, 1.0)) << "\n";
 }
 
 
 
-void ChessEngine::clearTables() {
+void ChessEngine::NewGame() {
     memset(history_moves, 0, sizeof(history_moves));
     memset(killer_moves, 0, sizeof(killer_moves));
+    memset(counter_moves, 0, sizeof(counter_moves));
     memset(pv_length, 0, sizeof(pv_length));
     memset(pv_table, 0, sizeof(pv_table));
+    BestLineLength = 0;
+
+    for (auto& helper : helpers) {
+        helper->NewGame();
+    }
+}
+
+// the last search is most likely two plies behind this one, so its killers and the rest of its pv
+// are shifted to where they belong now instead of being wiped. carrying history over measured
+// worse than starting it fresh, and it is small enough that resetting it costs nothing
+void ChessEngine::ageTables() {
+    memset(history_moves, 0, sizeof(history_moves));
+
+    for (int i = 0; i < max_ply; i++) {
+        killer_moves[0][i] = i + 2 < max_ply ? killer_moves[0][i + 2] : Move();
+        killer_moves[1][i] = i + 2 < max_ply ? killer_moves[1][i + 2] : Move();
+        pv_table[0][i] = i + 2 < BestLineLength ? BestLine[i + 2] : Move();
+    }
+
     count = 0;
+    sharedCount = 0;
+    nextYield = 0;
+    nextCheck = 0;
     ply = 0;
-}
\ No newline at end of file
+}
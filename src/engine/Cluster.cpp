@@ -0,0 +1,480 @@
+#include "engine/Cluster.h"
+#include "engine/UCIconnect.h"
+#include <cstdio>
+#include <sstream>
+
+#ifndef WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// unix:<path> or tcp:<host>:<port>, a listening tcp socket may leave the host out and is then
+// only reachable from this machine. a worker takes no password, other hosts have to be asked for
+static int openSocket(const std::string& address, bool listening) {
+	if (address.rfind("unix:", 0) == 0) {
+		const std::string path = address.substr(5);
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+			return -1;
+		}
+		strcpy(addr.sun_path, path.c_str());
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			return -1;
+		}
+		if (listening) {
+			unlink(path.c_str());
+		}
+		const bool ok = listening
+			? bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(fd, 1) == 0
+			: connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+		if (!ok) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (address.rfind("tcp:", 0) != 0) {
+		return -1;
+	}
+	const std::string rest = address.substr(4);
+	const size_t colon = rest.rfind(':');
+	std::string host = colon == std::string::npos ? "" : rest.substr(0, colon);
+	const std::string port = colon == std::string::npos ? rest : rest.substr(colon + 1);
+	// binding every interface has to be asked for with a host like 0.0.0.0
+	if (host.empty()) {
+		host = "127.0.0.1";
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+		return -1;
+	}
+
+	int fd = -1;
+	for (addrinfo* ai = found; ai && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+
+		const int one = 1;
+		bool ok;
+		if (listening) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0;
+		}
+		else {
+			ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+		}
+
+		if (!ok) {
+			close(fd);
+			fd = -1;
+			continue;
+		}
+		// stop and the info lines are single short lines, they shouldn't wait for more to send
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	freeaddrinfo(found);
+	return fd;
+}
+
+
+bool Cluster::Connect(const std::string& addresses) {
+	Disconnect();
+
+	std::stringstream list(addresses);
+	std::string address;
+	while (std::getline(list, address, ',')) {
+		address.erase(0, address.find_first_not_of(" \t"));
+		address.erase(address.find_last_not_of(" \t\r\n") + 1);
+		if (address.empty()) {
+			continue;
+		}
+
+		Worker worker;
+		worker.fd = openSocket(address, false);
+		worker.address = address;
+		worker.searching = false;
+		worker.nodes = 0;
+		if (worker.fd < 0) {
+			printf("info string could not connect to %s\n", address.c_str());
+			Disconnect();
+			return false;
+		}
+		workers.push_back(worker);
+	}
+
+	// a worker is only used once it answered, this also eats the id and option lines it starts with
+	for (Worker& worker : workers) {
+		const int start = GetTimeMs();
+		bool ready = false;
+		std::string line;
+
+		send(worker, "isready");
+		while (!ready && GetTimeMs() - start < 5000) {
+			pollfd pfd = { worker.fd, POLLIN, 0 };
+			if (poll(&pfd, 1, 100) > 0 && !receive(worker)) {
+				break;
+			}
+			while (!ready && nextLine(worker, line)) {
+				ready = line == "readyok";
+			}
+		}
+
+		if (!ready) {
+			printf("info string %s did not answer\n", worker.address.c_str());
+			Disconnect();
+			return false;
+		}
+	}
+
+	printf("info string connected to %d workers\n", (int)workers.size());
+	return Active();
+}
+
+
+void Cluster::Disconnect() {
+	for (Worker& worker : workers) {
+		send(worker, "quit");
+		close(worker.fd);
+	}
+	workers.clear();
+}
+
+
+void Cluster::Broadcast(const std::string& line) {
+	for (Worker& worker : workers) {
+		send(worker, line.substr(0, line.find_first_of("\r\n")));
+	}
+}
+
+
+bool Cluster::send(Worker& worker, const std::string& line) {
+	std::lock_guard<std::mutex> lock(sendLock);
+
+	const std::string data = line + "\n";
+	size_t sent = 0;
+	while (sent < data.size()) {
+		// a worker that went away must not take the coordinator down with a SIGPIPE
+		const ssize_t n = ::send(worker.fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) {
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+
+bool Cluster::receive(Worker& worker) {
+	char buffer[4096];
+	const ssize_t n = recv(worker.fd, buffer, sizeof(buffer), 0);
+	if (n <= 0) {
+		return false;
+	}
+	worker.input.append(buffer, n);
+	return true;
+}
+
+
+bool Cluster::nextLine(Worker& worker, std::string& line) {
+	const size_t end = worker.input.find('\n');
+	if (end == std::string::npos) {
+		return false;
+	}
+	line = worker.input.substr(0, end);
+	worker.input.erase(0, end + 1);
+	if (!line.empty() && line.back() == '\r') {
+		line.pop_back();
+	}
+	return true;
+}
+
+
+void Cluster::parse(Worker& worker, const std::string& line) {
+	std::istringstream tokens(line);
+	std::string token;
+	tokens >> token;
+
+	if (token == "bestmove") {
+		tokens >> worker.bestMove;
+		worker.searching = false;
+		return;
+	}
+	if (token != "info") {
+		return;
+	}
+
+	Report report = { 0, 0, "", "" };
+	int multipv = 1;
+	while (tokens >> token) {
+		if (token == "multipv") {
+			tokens >> multipv;
+		}
+		else if (token == "depth") {
+			tokens >> report.depth;
+		}
+		else if (token == "nodes") {
+			tokens >> worker.nodes;
+		}
+		else if (token == "score") {
+			std::string type;
+			int value = 0;
+			tokens >> type >> value;
+			report.text = type + " " + std::to_string(value);
+			// shorter mates first, both ways
+			if (type == "mate") {
+				report.score = value > 0 ? MATE_VALUE - value : -MATE_VALUE - value;
+			}
+			else {
+				report.score = value;
+			}
+		}
+		else if (token == "pv") {
+			std::getline(tokens, report.pv);
+			report.pv.erase(0, report.pv.find_first_not_of(' '));
+			report.pv.erase(report.pv.find_last_not_of(' ') + 1);
+		}
+	}
+
+	if (multipv != 1 || report.depth == 0 || report.pv.empty()) {
+		return;
+	}
+	// a failed aspiration window prints the same depth again
+	if (!worker.reports.empty() && worker.reports.back().depth == report.depth) {
+		worker.reports.back() = report;
+	}
+	else {
+		worker.reports.push_back(report);
+	}
+}
+
+
+const Cluster::Report* Cluster::reportAt(const Worker& worker, int depth) const {
+	for (const Report& report : worker.reports) {
+		if (report.depth == depth) {
+			return &report;
+		}
+	}
+	if (!worker.searching && !worker.reports.empty() && worker.reports.back().depth < depth) {
+		return &worker.reports.back();
+	}
+	return nullptr;
+}
+
+
+void Cluster::Search(const std::string& position, const std::string& go, const Board& board, const std::atomic<bool>& stop) {
+	std::string goLine = go.substr(0, go.find_first_of("\r\n"));
+
+	// the gui's own searchmoves narrows the root down before it is split
+	std::string allowed;
+	const size_t restrict = goLine.find("searchmoves");
+	if (restrict != std::string::npos) {
+		allowed = " " + goLine.substr(restrict + 11) + " ";
+		goLine.erase(restrict);
+	}
+
+	std::vector<std::string> rootMoves;
+	const LegalMoves legal = board.GenerateLegalMoves(board.currentPlayer);
+	for (int i = 0; i < legal.count; i++) {
+		const std::string move = legal.moves[i].to_str();
+		if (allowed.empty() || allowed.find(" " + move + " ") != std::string::npos) {
+			rootMoves.push_back(move);
+		}
+	}
+
+	if (rootMoves.empty()) {
+		printf("bestmove 0000\n");
+		return;
+	}
+
+	const size_t used = std::min(workers.size(), rootMoves.size());
+	for (size_t w = 0; w < used; w++) {
+		Worker& worker = workers[w];
+		std::string moves;
+		for (size_t m = w; m < rootMoves.size(); m += used) {
+			moves += " " + rootMoves[m];
+		}
+
+		worker.reports.clear();
+		worker.bestMove.clear();
+		worker.nodes = 0;
+		worker.searching = send(worker, position.substr(0, position.find_first_of("\r\n")))
+			&& send(worker, goLine + " searchmoves" + moves);
+	}
+
+	// a single engine stops deepening once it sees a mate, the cluster stops its other workers then
+	const bool waits = goLine.find("ponder") != std::string::npos || goLine.find("infinite") != std::string::npos;
+
+	const int start = GetTimeMs();
+	int mergedDepth = 0;
+	Report best = { 0, 0, "", "" };
+	bool stopSent = false;
+
+	while (true) {
+		std::vector<pollfd> fds;
+		std::vector<Worker*> polled;
+		for (size_t w = 0; w < used; w++) {
+			if (workers[w].searching) {
+				fds.push_back({ workers[w].fd, POLLIN, 0 });
+				polled.push_back(&workers[w]);
+			}
+		}
+		if (fds.empty()) {
+			break;
+		}
+
+		if ((stop || (best.score > MATE_SCORE && !waits)) && !stopSent) {
+			for (Worker* worker : polled) {
+				send(*worker, "stop");
+			}
+			stopSent = true;
+		}
+
+		if (poll(fds.data(), fds.size(), 10) > 0) {
+			for (size_t i = 0; i < fds.size(); i++) {
+				if (!fds[i].revents) {
+					continue;
+				}
+
+				Worker& worker = *polled[i];
+				if (!receive(worker)) {
+					printf("info string lost the connection to %s\n", worker.address.c_str());
+					worker.searching = false;
+					continue;
+				}
+
+				std::string line;
+				while (nextLine(worker, line)) {
+					parse(worker, line);
+				}
+			}
+		}
+
+		// a depth is done once every worker got through it, the best of their lines is the line of the cluster
+		while (true) {
+			const int depth = mergedDepth + 1;
+			const Report* top = nullptr;
+			bool complete = true, reached = false;
+
+			for (size_t w = 0; w < used && complete; w++) {
+				if (!workers[w].searching && workers[w].reports.empty()) {
+					continue;
+				}
+
+				const Report* report = reportAt(workers[w], depth);
+				if (!report) {
+					complete = false;
+					break;
+				}
+
+				reached |= report->depth == depth;
+				if (!top || report->score > top->score) {
+					top = report;
+				}
+			}
+
+			if (!complete || !reached || !top) {
+				break;
+			}
+
+			mergedDepth = depth;
+			best = *top;
+
+			int64_t nodes = 0;
+			for (size_t w = 0; w < used; w++) {
+				nodes += workers[w].nodes;
+			}
+			const int timediff = GetTimeMs() - start;
+			printf("info score %s depth %d nodes %lld time %d nps %lld pv %s\n", best.text.c_str(), depth, (long long)nodes, timediff,
+				(long long)(nodes / (timediff == 0 ? 1 : timediff) * 1000), best.pv.c_str());
+		}
+		fflush(stdout);
+	}
+
+	std::string move, ponder;
+	std::istringstream pv(best.pv);
+	pv >> move >> ponder;
+
+	// stopped before any depth was through on every worker, take any move a worker settled on
+	for (size_t w = 0; w < used && move.empty(); w++) {
+		move = workers[w].bestMove;
+	}
+	if (move.empty()) {
+		move = legal.moves[0].to_str();
+	}
+
+	if (ponder.empty()) {
+		printf("bestmove %s\n", move.c_str());
+	}
+	else {
+		printf("bestmove %s ponder %s\n", move.c_str(), ponder.c_str());
+	}
+	fflush(stdout);
+}
+
+
+bool Cluster::Listen(const std::string& address) {
+	const int listener = openSocket(address, true);
+	if (listener < 0) {
+		printf("could not listen on %s\n", address.c_str());
+		return false;
+	}
+	printf("listening on %s\n", address.c_str());
+	fflush(stdout);
+
+	const int fd = accept(listener, nullptr, nullptr);
+	close(listener);
+	if (address.rfind("unix:", 0) == 0) {
+		unlink(address.substr(5).c_str());
+	}
+	if (fd < 0) {
+		return false;
+	}
+
+	// the uci loop reads stdin and prints to stdout, the connection takes their place
+	dup2(fd, 0);
+	dup2(fd, 1);
+	close(fd);
+
+	UCIconnection connection;
+	connection.Loop(true);
+	return true;
+}
+
+#else
+
+bool Cluster::Connect(const std::string& addresses) {
+	printf("info string cluster mode needs unix sockets\n");
+	return false;
+}
+
+void Cluster::Disconnect() {
+}
+
+void Cluster::Broadcast(const std::string& line) {
+}
+
+void Cluster::Search(const std::string& position, const std::string& go, const Board& board, const std::atomic<bool>& stop) {
+}
+
+bool Cluster::Listen(const std::string& address) {
+	printf("cluster mode needs unix sockets\n");
+	return false;
+}
+
+#endif
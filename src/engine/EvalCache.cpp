@@ -0,0 +1,32 @@
+#include "engine/EvalCache.h"
+
+
+void EvalCache::Resize(size_t mb) {
+	delete[] entries;
+	entries = 0;
+	entryCount = 0;
+
+	if (!mb) {
+		return;
+	}
+
+	size_t count = 1;
+	while (count * 2 * sizeof(uint64_t) <= (mb << 20)) {
+		count *= 2;
+	}
+
+	entries = new (std::nothrow) uint64_t[count];
+	if (!entries) {
+		printf("info string could not allocate the eval cache\n");
+		return;
+	}
+
+	entryCount = count;
+	clear();
+}
+
+
+void EvalCache::clear() {
+	// an empty entry only matches keys with a zero high half, as unlikely as any other collision
+	memset(entries, 0, entryCount * sizeof(uint64_t));
+}
@@ -0,0 +1,169 @@
+#include "engine/MovePicker.h"
+
+// a queen promotion goes ahead of every quiet move, history never gets anywhere near it
+#define PROMOTION_BONUS 1000000
+
+
+//this is needed becuase the value of the piece enum is used for rendering too
+constexpr static int translator[6] =
+{
+	5,
+	6,
+	4,
+	2,
+	3,
+	1
+};
+
+
+MovePicker::MovePicker(const Board& _board, Move _ttMove, Move killer1, Move killer2, Move counter, const int _history[12][64])
+	: board(_board), history(_history), stage(TT_MOVE), refutation(0), triedCount(0), current(0), badCount(0) {
+	ttMove = board.LegalMove(_ttMove);
+	if (ttMove != Move()) {
+		tried[triedCount++] = ttMove;
+	}
+
+	refutations[0] = killer1;
+	refutations[1] = killer2;
+	refutations[2] = counter;
+}
+
+
+MovePicker::MovePicker(const Board& _board)
+	: board(_board), history(nullptr), stage(QS_GENERATE_CAPTURES), refutation(0), triedCount(0), current(0), badCount(0) {
+}
+
+
+// mvv-lva, a promotion counts as taking the piece it becomes too
+int MovePicker::captureScore(Move move) {
+	//translator is just a shortcut i use cuz  i use the vaalue of the piece enum for rendering too, just treat it as the pieces ordered by value
+	int score = (6 - translator[move.getPiece() - 1]) + translator[move.getCapturedPiece() - 1] * 100;
+	if (move.getFlags() == PROMOTE) {
+		score += translator[move.getPiece() - 1] * 100;
+	}
+	return score;
+}
+
+
+Move MovePicker::pickBest(LegalMoves& list) {
+	int best = current;
+	for (int i = current + 1; i < list.count; i++) {
+		if (scores[i] > scores[best]) {
+			best = i;
+		}
+	}
+	std::swap(list.moves[current], list.moves[best]);
+	std::swap(scores[current], scores[best]);
+	return list.moves[current++];
+}
+
+
+bool MovePicker::wasTried(Move move) const {
+	for (int i = 0; i < triedCount; i++) {
+		if (sameMove(tried[i], move)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+Move MovePicker::Next() {
+	switch (stage) {
+	case TT_MOVE:
+		stage = GENERATE_CAPTURES;
+		if (ttMove != Move()) {
+			return ttMove;
+		}
+		[[fallthrough]];
+
+	case GENERATE_CAPTURES:
+		captures = board.GenerateCaptureMoves(board.currentPlayer);
+		for (int i = 0; i < captures.count; i++) {
+			scores[i] = captureScore(captures.moves[i]);
+		}
+		current = 0;
+		stage = GOOD_CAPTURES;
+		[[fallthrough]];
+
+	case GOOD_CAPTURES:
+		while (current < captures.count) {
+			const Move move = pickBest(captures);
+			if (wasTried(move)) {
+				continue;
+			}
+			// the slot it came from is already behind current
+			if (move.getFlags() != PROMOTE && !board.StaticExchange(move)) {
+				captures.moves[badCount++] = move;
+				continue;
+			}
+			return move;
+		}
+		stage = REFUTATIONS;
+		[[fallthrough]];
+
+	case REFUTATIONS:
+		while (refutation < 3) {
+			const Move move = board.LegalMove(refutations[refutation++]);
+			if (move == Move() || move.getCapturedPiece() != EMPTY || wasTried(move)) {
+				continue;
+			}
+			tried[triedCount++] = move;
+			return move;
+		}
+		current = 0;
+		stage = BAD_CAPTURES;
+		[[fallthrough]];
+
+	case BAD_CAPTURES:
+		// losing captures still do better before the quiet moves than after them, the quiets are often
+		// not needed at all then
+		if (current < badCount) {
+			return captures.moves[current++];
+		}
+		stage = GENERATE_QUIETS;
+		[[fallthrough]];
+
+	case GENERATE_QUIETS:
+		quiets = board.GenerateQuietMoves(board.currentPlayer);
+		for (int i = 0; i < quiets.count; i++) {
+			const Move move = quiets.moves[i];
+			scores[i] = history[(move.getPiece() - 1) * (move.getColor() + 1)][move.getTo()];
+			if (move.getFlags() == PROMOTE && move.getPiece() == QUEEN) {
+				scores[i] += PROMOTION_BONUS;
+			}
+		}
+		current = 0;
+		stage = QUIETS;
+		[[fallthrough]];
+
+	case QUIETS:
+		while (current < quiets.count) {
+			const Move move = pickBest(quiets);
+			if (!wasTried(move)) {
+				return move;
+			}
+		}
+		stage = DONE;
+		return Move();
+
+	case QS_GENERATE_CAPTURES:
+		captures = board.GenerateCaptureMoves(board.currentPlayer);
+		for (int i = 0; i < captures.count; i++) {
+			scores[i] = captureScore(captures.moves[i]);
+		}
+		current = 0;
+		stage = QS_CAPTURES;
+		[[fallthrough]];
+
+	case QS_CAPTURES:
+		if (current < captures.count) {
+			return pickBest(captures);
+		}
+		stage = DONE;
+		[[fallthrough]];
+
+	default:
+		return Move();
+	}
+}
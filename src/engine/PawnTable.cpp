@@ -0,0 +1,138 @@
+#include "engine/PawnTable.h"
+
+#define DOUBLED_PAWN -10
+#define ISOLATED_PAWN -12
+#define BACKWARD_PAWN -8
+
+#define SHELTER_NEAR 10
+#define SHELTER_FAR 5
+#define SHELTER_MISSING -15
+
+// by rank counted from the pawns own side
+static const int passedBonus[8] = { 0, 5, 10, 20, 35, 60, 100, 0 };
+
+static const uint64_t fileA = 0x0101010101010101ULL;
+
+
+static inline uint64_t fileMask(int file) {
+	return fileA << file;
+}
+
+static inline uint64_t adjacentFiles(int file) {
+	return (file > 0 ? fileMask(file - 1) : 0) | (file < 7 ? fileMask(file + 1) : 0);
+}
+
+// every square on the ranks in front of rank, seen from color
+static inline uint64_t ranksAhead(Color color, int rank) {
+	return color == WHITE ? (rank == 7 ? 0 : ~0ULL << (8 * (rank + 1))) : (rank == 0 ? 0 : ~0ULL >> (8 * (8 - rank)));
+}
+
+static inline uint64_t pawnAttacks(Color color, uint64_t pawns) {
+	const uint64_t pushed = color == WHITE ? pawns << 8 : pawns >> 8;
+	return ((pushed >> 1) & ~0x8080808080808080ULL) | ((pushed << 1) & ~0x0101010101010101ULL);
+}
+
+
+void PawnTable::clear() {
+	memset(entries, 0, sizeof(entries));
+
+	// a key that can't map to its own slot, a zero key is a real position without pawns
+	for (int i = 0; i < PAWN_HASH_ENTRIES; i++) {
+		entries[i].key = i ^ 1;
+	}
+}
+
+
+void PawnTable::compute(const Board& board, PawnEntry* entry) const {
+	entry->key = board.pawnKey;
+	entry->score = 0;
+
+	for (int c = BLACK; c <= WHITE; c++) {
+		const Color color = static_cast<Color>(c);
+		const int sign = color == WHITE ? 1 : -1;
+
+		const uint64_t own = board.getPieces(color, PAWN);
+		const uint64_t enemy = board.getPieces(static_cast<Color>(!color), PAWN);
+		const uint64_t enemyAttacks = pawnAttacks(static_cast<Color>(!color), enemy);
+
+		int score = 0;
+
+		uint64_t pawns = own;
+		while (pawns) {
+			const int square = getLSB(pawns);
+			pawns &= pawns - 1;
+
+			const int file = square % 8;
+			const int rank = square / 8;
+			const int relativeRank = color == WHITE ? rank : 7 - rank;
+
+			const uint64_t ahead = ranksAhead(color, rank);
+
+			// only the rearmost pawn of a file counts as doubled
+			if (own & fileMask(file) & ahead) {
+				score += DOUBLED_PAWN;
+			}
+
+			if (!(own & adjacentFiles(file))) {
+				score += ISOLATED_PAWN;
+			}
+			// no neighbour level with or behind it can ever defend it, and it can't step up without being taken
+			else if (!(own & adjacentFiles(file) & ~ahead)) {
+				const int stop = color == WHITE ? square + 8 : square - 8;
+				if (enemyAttacks & (1ULL << stop)) {
+					score += BACKWARD_PAWN;
+				}
+			}
+
+			if (!(enemy & (fileMask(file) | adjacentFiles(file)) & ahead)) {
+				score += passedBonus[relativeRank];
+			}
+		}
+
+		entry->score += sign * score;
+
+		// for every file the king could be on, the pawns in front of it on that file and its neighbours
+		const uint64_t secondRank = color == WHITE ? 0xff00ULL : 0x00ff000000000000ULL;
+		const uint64_t thirdRank = color == WHITE ? 0xff0000ULL : 0x0000ff0000000000ULL;
+
+		for (int kingFile = 0; kingFile < 8; kingFile++) {
+			int shelter = 0;
+			for (int file = std::max(kingFile - 1, 0); file <= std::min(kingFile + 1, 7); file++) {
+				if (own & secondRank & fileMask(file)) {
+					shelter += SHELTER_NEAR;
+				}
+				else if (own & thirdRank & fileMask(file)) {
+					shelter += SHELTER_FAR;
+				}
+				else {
+					shelter += SHELTER_MISSING;
+				}
+			}
+			entry->shelter[color][kingFile] = shelter;
+		}
+	}
+}
+
+
+int PawnTable::Evaluate(const Board& board) {
+	PawnEntry* entry = &entries[board.pawnKey & (PAWN_HASH_ENTRIES - 1)];
+
+	if (entry->key != board.pawnKey) {
+		compute(board, entry);
+	}
+
+	int score = entry->score;
+
+	// the shelter only matters while the king still sits on its first two ranks
+	const int whiteKing = getLSB(board.getPieces(WHITE, KING));
+	if (whiteKing / 8 <= 1) {
+		score += entry->shelter[WHITE][whiteKing % 8];
+	}
+
+	const int blackKing = getLSB(board.getPieces(BLACK, KING));
+	if (blackKing / 8 >= 6) {
+		score -= entry->shelter[BLACK][blackKing % 8];
+	}
+
+	return board.currentPlayer == WHITE ? score : -score;
+}
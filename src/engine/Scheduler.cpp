@@ -0,0 +1,205 @@
+#include "engine/Scheduler.h"
+#include <chrono>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+// only the pages a search touches get memory, the deepest search with quiescence on top stays far below it
+#define SEARCH_STACK_SIZE (8 << 20)
+
+
+static int64_t nowUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the search a thread is about to start, makecontext has no portable way to pass it a pointer
+static thread_local ScheduledGame* starting;
+
+
+ScheduledGame::~ScheduledGame() {
+#ifndef WIN32
+	if (stack) {
+		munmap(stack, SEARCH_STACK_SIZE);
+	}
+#endif
+}
+
+
+SearchScheduler::SearchScheduler(int _threads, int sliceMs)
+	: threadCount(std::max(_threads, 1)), sliceUs(int64_t(std::max(sliceMs, 1)) * 1000), outstanding(0), quit(false), switches(0) {
+	for (int i = 0; i < threadCount; i++) {
+		threads.emplace_back(&SearchScheduler::work, this);
+	}
+}
+
+
+SearchScheduler::~SearchScheduler() {
+	WaitIdle();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+
+void SearchScheduler::Submit(ScheduledGame* game, std::function<void(ScheduledGame*)> done) {
+	game->done = std::move(done);
+	game->running = false;
+	game->finished = false;
+	game->submitTime = GetTimeMs();
+	game->firstRunTime = 0;
+	game->doneTime = 0;
+	game->runUs = 0;
+	game->slices = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending.push_back(game);
+		outstanding++;
+	}
+	wake.notify_one();
+}
+
+
+void SearchScheduler::WaitIdle() {
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this] { return outstanding == 0; });
+}
+
+
+void SearchScheduler::work() {
+	// the searches this thread started, in the order they get their next slice
+	std::deque<ScheduledGame*> held;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+
+			// a thread only takes on another search while it holds less than its share, so they spread over the threads
+			const size_t share = (outstanding + threadCount - 1) / threadCount;
+			if (!pending.empty() && held.size() < std::max<size_t>(share, 1)) {
+				held.push_back(pending.front());
+				pending.pop_front();
+			}
+
+			if (held.empty()) {
+				if (quit) {
+					return;
+				}
+				wake.wait(guard);
+				continue;
+			}
+		}
+
+		ScheduledGame* game = held.front();
+		held.pop_front();
+
+		resume(game);
+		if (!game->finished) {
+			held.push_back(game);
+			continue;
+		}
+
+		game->doneTime = GetTimeMs();
+		// done may submit the game again, which replaces the callback that is running
+		auto done = std::move(game->done);
+		done(game);
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (--outstanding == 0) {
+			idle.notify_all();
+		}
+	}
+}
+
+
+void SearchScheduler::resume(ScheduledGame* game) {
+	const int64_t now = nowUs();
+
+	if (!game->running) {
+		game->running = true;
+		game->firstRunTime = GetTimeMs();
+		game->suspendedUs = 0;
+
+		ChessEngine& engine = game->engine;
+		engine.stop = false;
+		engine.ponder = false;
+		engine.maxNodes = 0;
+		engine.maxTime = game->budgetMs > 0 ? game->budgetMs : 100000000;
+		engine.startTime = game->searchStart = game->firstRunTime;
+		engine.yield = [this, game] { yield(game); };
+	}
+	else {
+		// waiting for the thread doesn't count against the budget, the search sees a clock that stood still
+		game->suspendedUs += now - game->switchTime;
+		game->engine.startTime = game->searchStart + (int)(game->suspendedUs / 1000);
+	}
+
+	game->switchTime = now;
+	game->slices++;
+
+#ifndef WIN32
+	ucontext_t home;
+	game->home = &home;
+
+	if (game->slices == 1) {
+		if (!game->stack) {
+			game->stack = (char*)mmap(nullptr, SEARCH_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+			if (game->stack == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+			// running off the end faults on the guard page instead of writing over other memory
+			mprotect(game->stack, 4096, PROT_NONE);
+		}
+
+		getcontext(&game->context);
+		game->context.uc_stack.ss_sp = game->stack;
+		game->context.uc_stack.ss_size = SEARCH_STACK_SIZE;
+		game->context.uc_link = nullptr;
+		makecontext(&game->context, entry, 0);
+		starting = game;
+	}
+
+	swapcontext(&home, &game->context);
+#else
+	// no contexts to switch, every search runs to the end once it got a thread
+	starting = game;
+	entry();
+#endif
+
+	const int64_t out = nowUs();
+	game->runUs += out - game->switchTime;
+	game->switchTime = out;
+}
+
+
+void SearchScheduler::yield(ScheduledGame* game) {
+#ifndef WIN32
+	// the engine calls in every YIELD_NODES nodes, the slice is measured on the clock
+	if (nowUs() - game->switchTime < sliceUs) {
+		return;
+	}
+
+	switches.fetch_add(1, std::memory_order_relaxed);
+	swapcontext(&game->context, game->home);
+#endif
+}
+
+
+void SearchScheduler::entry() {
+	ScheduledGame* game = starting;
+
+	game->bestMove = game->engine.BestMove(game->depth, game->board);
+	game->engine.yield = nullptr;
+	game->running = false;
+	game->finished = true;
+
+#ifndef WIN32
+	// the context has no link, it goes back to the resume that switched to it last
+	setcontext(game->home);
+#endif
+}
@@ -1,7 +1,287 @@
 #include "engine/TT.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(WIN32)
+#include <windows.h>
+#endif
+
+#include <vector>
+#include <cstdio>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#define SNAPSHOT_MAGIC 0x54544347 // "GCTT"
+#define SNAPSHOT_VERSION 1
+
+// the clusters start one page into the file so they can be mapped straight from it
+#define SNAPSHOT_HEADER_SIZE 4096
+
+struct SnapshotHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t keySignature;
+	uint32_t clusterBytes;
+	uint32_t clusterEntries;
+	uint64_t clusterCount;
+	uint8_t generation;
+};
+
+
+bool TTable::allocate(size_t count) {
+	const size_t bytes = count * sizeof(TTCluster);
+
+#if defined(__linux__)
+	// map whole huge pages and ask for them to be backed by transparent huge pages,
+	// one extra page is mapped so the table can start on a huge page boundary
+	const size_t length = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	// the clear right after touches every page, a table the machine can't hold would get the process
+	// killed there instead of failing here and being retried at half the size. the mapping is counted
+	// against the commit limit for the same reason
+	const size_t physical = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+	if (length > physical) {
+		return false;
+	}
+	void* mem = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (mem != MAP_FAILED) {
+		char* start = (char*)mem;
+		char* aligned = (char*)(((uintptr_t)start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+
+		if (aligned != start) {
+			munmap(start, aligned - start);
+		}
+		if (aligned != start + HUGE_PAGE_SIZE) {
+			munmap(aligned + length, start + HUGE_PAGE_SIZE - aligned);
+		}
+
+		// without THP support this fails and we simply keep regular pages
+		madvise(aligned, length, MADV_HUGEPAGE);
+
+		clusters = (TTCluster*)aligned;
+		mappedBytes = length;
+	}
+#elif defined(WIN32)
+	clusters = (TTCluster*)VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	mappedBytes = clusters ? bytes : 0;
+#endif
+
+	if (!clusters) {
+		clusters = new (std::nothrow) TTCluster[count]();
+	}
+
+	clusterCount = clusters ? count : 0;
+	return clusters != 0;
+}
+
+
+void TTable::Resize(size_t mb) {
+	release();
+
+	const size_t requested = std::max<size_t>(mb, 1) << 20;
+
+	for (size_t bytes = requested; bytes >= sizeof(TTCluster); bytes /= 2) {
+		if (allocate(bytes / sizeof(TTCluster))) {
+			// mapped memory is already zero, clearing it anyway makes the clear threads
+			// fault the pages in so they land on their nodes instead of the first searcher's
+			clear();
+
+			if (bytes < requested) {
+				printf("info string could only allocate %llu MB of hash\n", (unsigned long long)(bytes >> 20));
+			}
+			return;
+		}
+	}
+
+	printf("info string could not allocate a transposition table\n");
+	exit(1);
+}
+
+
+int TTable::Hashfull() const {
+	const size_t sample = std::min<size_t>(clusterCount, 1000 / TT_CLUSTER_SIZE);
+	int used = 0;
+
+	for (size_t i = 0; i < sample; i++) {
+		for (int j = 0; j < TT_CLUSTER_SIZE; j++) {
+			const TTEntry entry = clusters[i].entries[j].load(std::memory_order_relaxed);
+			used += entry.data != 0 && entry.generation() == generation;
+		}
+	}
+
+	return used * 1000 / (sample * TT_CLUSTER_SIZE);
+}
+
+
+void TTable::clear() {
+	const size_t bytes = clusterCount * sizeof(TTCluster);
+
+	// slices are whole huge pages so no page is shared between two threads
+	const size_t pages = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE;
+	const size_t threads = std::min<size_t>(std::max(clearThreads, 1), pages);
+
+	auto clearSlice = [this, bytes, pages, threads](size_t index) {
+		const size_t start = std::min(bytes, pages * index / threads * HUGE_PAGE_SIZE);
+		const size_t end = std::min(bytes, pages * (index + 1) / threads * HUGE_PAGE_SIZE);
+		memset((char*)clusters + start, 0, end - start);
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < threads; i++) {
+		workers.emplace_back(clearSlice, i);
+	}
+	clearSlice(0);
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+
+	generation = 0;
+}
+
+
+bool TTable::Save(const std::string& path) const {
+	SnapshotHeader header = {};
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.keySignature = Masks::hashKeySignature();
+	header.clusterBytes = sizeof(TTCluster);
+	header.clusterEntries = TT_CLUSTER_SIZE;
+	header.clusterCount = clusterCount;
+	header.generation = generation;
+
+	char page[SNAPSHOT_HEADER_SIZE] = {};
+	memcpy(page, &header, sizeof(header));
+
+	// written next to the target and renamed over it, a table loaded from the old file
+	// keeps its mapping of the old contents
+	const std::string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	bool ok = fwrite(page, 1, sizeof(page), file) == sizeof(page) &&
+		fwrite(clusters, sizeof(TTCluster), clusterCount, file) == clusterCount;
+	ok &= fclose(file) == 0;
+
+	if (ok) {
+		std::remove(path.c_str());
+		ok = std::rename(temp.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) {
+		std::remove(temp.c_str());
+	}
+	return ok;
+}
+
+
+bool TTable::Load(const std::string& path) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		printf("info string can't open %s\n", path.c_str());
+		return false;
+	}
+
+	SnapshotHeader header = {};
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+		header.clusterBytes != sizeof(TTCluster) || header.clusterEntries != TT_CLUSTER_SIZE || header.clusterCount == 0) {
+		printf("info string %s is not a hash snapshot of this version\n", path.c_str());
+		fclose(file);
+		return false;
+	}
+
+	// entries only hold the low key bits, with other zobrist keys they would describe other positions
+	if (header.keySignature != Masks::hashKeySignature()) {
+		printf("info string %s was saved with different hash keys\n", path.c_str());
+		fclose(file);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	const long long fileSize = ftell(file);
+	const size_t bytes = header.clusterCount * sizeof(TTCluster);
+	if (fileSize < (long long)(SNAPSHOT_HEADER_SIZE + bytes)) {
+		printf("info string %s is truncated\n", path.c_str());
+		fclose(file);
+		return false;
+	}
+
+	release();
+
+#if defined(__linux__)
+	// a private mapping of the file is the table, pages are read in as the search touches
+	// them and copied only once they are written
+	int fd = open(path.c_str(), O_RDONLY);
+	void* mem = fd < 0 ? MAP_FAILED : mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, SNAPSHOT_HEADER_SIZE);
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	if (mem != MAP_FAILED) {
+		fclose(file);
+		clusters = (TTCluster*)mem;
+		clusterCount = header.clusterCount;
+		mappedBytes = bytes;
+		generation = header.generation;
+		return true;
+	}
+#endif
+
+	if (!allocate(header.clusterCount)) {
+		printf("info string could not allocate %llu MB of hash\n", (unsigned long long)(bytes >> 20));
+		fclose(file);
+		Resize(HASH_SIZE);
+		return false;
+	}
+
+	fseek(file, SNAPSHOT_HEADER_SIZE, SEEK_SET);
+	const bool ok = fread(clusters, sizeof(TTCluster), clusterCount, file) == clusterCount;
+	fclose(file);
+
+	if (!ok) {
+		clear();
+		return false;
+	}
+
+	generation = header.generation;
+	return true;
+}
+
+
+void TTable::release() {
+	if (!clusters) {
+		return;
+	}
+
+#if defined(__linux__)
+	if (mappedBytes) {
+		munmap(clusters, mappedBytes);
+	}
+#elif defined(WIN32)
+	if (mappedBytes) {
+		VirtualFree(clusters, 0, MEM_RELEASE);
+	}
+#endif
+
+	if (!mappedBytes) {
+		delete[] clusters;
+	}
+
+	clusters = 0;
+	clusterCount = 0;
+	mappedBytes = 0;
+}
+
 
 void TTable::WriteHash(uint64_t key, int score, int depth, Move bestMove, HashFlags flag, int ply) {
-	THash* hashEntry = &hashTable[key % size];
+	TTCluster* bucket = cluster(key);
+	const uint16_t key16 = key & 0xffff;
 
 	if (score < -MATE_SCORE) {
 		score -= ply;
@@ -11,23 +291,153 @@ void TTable::WriteHash(uint64_t key, int score, int depth, Move bestMove, HashFl
 		score += ply;
 	}
 
-	hashEntry->key = key;
-	hashEntry->score = score;
-	hashEntry->flag = flag;
-	hashEntry->depth = depth;
-	hashEntry->bestMove = bestMove;
+	depth = std::min(depth, 0x7f);
+
+	TT_STAT(stats.writes);
+
+	// pick the slot holding this position if there is one, otherwise an empty slot,
+	// otherwise the entry that is worth the least (shallow and from old searches)
+	std::atomic<uint64_t>* replace = &bucket->entries[0];
+	int replaceWorth = INT32_MAX;
+
+	for (int i = 0; i < TT_CLUSTER_SIZE; i++) {
+		const TTEntry entry = bucket->entries[i].load(std::memory_order_relaxed);
+
+		if (entry.data == 0) {
+			if (replaceWorth > INT32_MIN) {
+				replace = &bucket->entries[i];
+				replaceWorth = INT32_MIN;
+			}
+			continue;
+		}
+
+		if (entry.key16() == key16) {
+			// keep a deeper result for the same position unless the new one is exact or the old one is stale
+			if (flag != HASH_EXSACT && entry.depth() > depth + 2 && age(entry) == 0) {
+				return;
+			}
+
+			if (bestMove == Move()) {
+				bestMove = entry.move();
+			}
+			replace = &bucket->entries[i];
+			break;
+		}
+
+		const int worth = entry.depth() - 8 * age(entry);
+		if (worth < replaceWorth) {
+			replace = &bucket->entries[i];
+			replaceWorth = worth;
+		}
+	}
+
+#ifdef TT_STATS
+	const TTEntry victim = replace->load(std::memory_order_relaxed);
+	if (victim.data != 0 && victim.key16() != key16 && victim.depth() > depth) {
+		TT_STAT(stats.deeperOverwrites);
+	}
+#endif
+
+	// another thread may have picked the same slot, whichever store lands last wins as a whole
+	replace->store(TTEntry::pack(key16, bestMove, score, depth, flag, generation), std::memory_order_relaxed);
 }
 
 
 bool TTable::ProbeHash(uint64_t key, THash* hashEntry, int ply) {
-	*hashEntry = hashTable[key % size];
+	TTCluster* bucket = cluster(key);
+	const uint16_t key16 = key & 0xffff;
+
+	TT_STAT(stats.probes);
+
+	for (int i = 0; i < TT_CLUSTER_SIZE; i++) {
+		uint64_t data = bucket->entries[i].load(std::memory_order_relaxed);
+		TTEntry entry(data);
+
+		if (entry.data == 0 || entry.key16() != key16) {
+			continue;
+		}
+
+		if (entry.generation() != generation) {
+			// only refresh the age if nobody replaced the entry in the meantime
+			TTEntry refreshed = entry;
+			refreshed.setGeneration(generation);
+			bucket->entries[i].compare_exchange_strong(data, refreshed.data, std::memory_order_relaxed);
+		}
+
+		TT_STAT(stats.hits);
+
+		hashEntry->score = entry.score();
+		hashEntry->depth = entry.depth();
+		hashEntry->flag = entry.flag();
+		hashEntry->bestMove = entry.move();
+
+		if (hashEntry->score > MATE_SCORE)
+			hashEntry->score -= ply;
+		else if (hashEntry->score < -MATE_SCORE)
+			hashEntry->score += ply;
 
-	if (hashEntry->score > MATE_SCORE)
-		hashEntry->score -= ply;
-	else if (hashEntry->score < -MATE_SCORE)
-		hashEntry->score += ply;
+		return true;
+	}
 
-	return hashEntry->key == key;
+	return false;
 }
 
 
+PerftTable::PerftTable(size_t mb) : entries(0), entryCount(0) {
+	size_t count = 2;
+	while (count * 2 * sizeof(PerftEntry) <= (std::max<size_t>(mb, 1) << 20)) {
+		count *= 2;
+	}
+
+	entries = new (std::nothrow) PerftEntry[count];
+	if (!entries) {
+		printf("info string could not allocate the perft table\n");
+		return;
+	}
+
+	entryCount = count;
+	for (size_t i = 0; i < count; i++) {
+		entries[i].check.store(0, std::memory_order_relaxed);
+		entries[i].data.store(0, std::memory_order_relaxed);
+	}
+}
+
+
+bool PerftTable::Probe(uint64_t key, int depth, uint64_t* nodes) const {
+	if (!entryCount) {
+		return false;
+	}
+
+	key = depthKey(key, depth);
+	const PerftEntry* slots = bucket(key);
+
+	for (int i = 0; i < 2; i++) {
+		const uint64_t data = slots[i].data.load(std::memory_order_relaxed);
+		const uint64_t check = slots[i].check.load(std::memory_order_relaxed);
+
+		if (data && (check ^ data) == key && (int)(data & 0xff) == depth) {
+			*nodes = data >> 8;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void PerftTable::Store(uint64_t key, int depth, uint64_t nodes) {
+	if (!entryCount) {
+		return;
+	}
+
+	key = depthKey(key, depth);
+	PerftEntry* slots = bucket(key);
+
+	// counts of deeper subtrees cost more to redo, they keep the first slot
+	const uint64_t kept = slots[0].data.load(std::memory_order_relaxed);
+	PerftEntry* slot = (int)(kept & 0xff) <= depth ? &slots[0] : &slots[1];
+
+	const uint64_t data = (nodes << 8) | (uint64_t)(depth & 0xff);
+	slot->data.store(data, std::memory_order_relaxed);
+	slot->check.store(key ^ data, std::memory_order_relaxed);
+}
@@ -1,7 +1,49 @@
 #include "engine/UCIconnect.h"
+#include <thread>
+#include <vector>
+#include <random>
+#include <set>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <numeric>
 #define INPUTBUFFER 400 * 6
 #define NAME "GrandChess"
 
+// commands that need the engine to themselves, a running search is stopped before they run.
+// anything else is answered or ignored while it keeps searching
+static const char* idle_commands[] = {
+    "stop", "quit", "position", "go", "ucinewgame", "setoption",
+    "bench", "farm", "epd ", "perft", "hashstress", "savehash ", "loadhash ", "genbench", "hashbench",
+};
+
+static bool needsIdle(const char* line) {
+    for (const char* command : idle_commands) {
+        if (!strncmp(line, command, strlen(command))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// what a cluster worker answers, see Cluster::Search. the coordinator keeps the Cluster option to itself
+static const char* worker_commands[] = {
+    "position", "go", "stop", "setoption", "ponderhit", "isready", "ucinewgame", "quit",
+};
+
+static bool workerCommand(const char* line) {
+    if (!strncmp(line, "setoption name Cluster ", 23)) {
+        return false;
+    }
+    for (const char* command : worker_commands) {
+        if (!strncmp(line, command, strlen(command))) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 
 
@@ -62,7 +104,7 @@ std::string bench_fens[] = {
 
 
 
-void UCIconnection::Loop() {
+void UCIconnection::Loop(bool worker) {
 
     setbuf(stdin, NULL);
     setbuf(stdout, NULL);
@@ -70,42 +112,139 @@ void UCIconnection::Loop() {
     char line[INPUTBUFFER]  ;
     printf("id name %s\n", NAME);
     printf("id author Uri Singer\n");
-    printf("option name Hash type spin default 64 min 4 max %d\n", HASH_MAX);
+    printf("option name Hash type spin default %d min 4 max %d\n", HASH_SIZE, HASH_MAX);
+    printf("option name Threads type spin default 1 min 1 max %d\n", THREADS_MAX);
+    printf("option name EvalCache type spin default %d min 0 max %d\n", EVAL_CACHE_SIZE, EVAL_CACHE_MAX);
+    printf("option name MultiPV type spin default 1 min 1 max %d\n", MULTIPV_MAX);
+    printf("option name Ponder type check default false\n");
     printf("option name Book type check default true\n");
+    printf("option name Cluster type string default <empty>\n");
     printf("uciok\n");
 
-    int MB = 64;
+    int MB = HASH_SIZE;
 
     while (true) {
         memset(&line[0], 0, sizeof(line));
         fflush(stdout);
+        // the gui going away is as good as a quit
         if (!fgets(line, INPUTBUFFER, stdin))
-            continue;
+            strcpy(line, "quit\n");
 
         if (line[0] == '\n')
             continue;
 
+        if (worker && !workerCommand(line)) {
+            printf("info string not available to a cluster worker\n");
+            continue;
+        }
+
+        // answered right away, even in the middle of a search
         if (!strncmp(line, "isready", 7)) {
             printf("readyok\n");
             continue;
         }
+
+        // the move we pondered on was played, the search carries on as a timed one. the time go gave it
+        // counts from now, the pondering so far was on the opponent's clock
+        if (!strncmp(line, "ponderhit", 9)) {
+            if (_engine.ponder) {
+                // the search only reads maxTime once ponder is clear, so it sees the new value
+                _engine.maxTime += GetTimeMs() - _engine.startTime;
+                _engine.ponder = false;
+            }
+            _cluster.Broadcast(line);
+            continue;
+        }
+
+        if (needsIdle(line)) {
+            stopSearch();
+        }
+
+        if (!strncmp(line, "stop", 4)) {
+            continue;
+        }
+
+        // the workers of a cluster search with the options of the coordinator
+        if (!strncmp(line, "setoption", 9) && strncmp(line, "setoption name Cluster ", 23)) {
+            _cluster.Broadcast(line);
+        }
         if (!strncmp(line, "bench", 5)) {
-            int depth = atoi(line + 5);
-            bench(depth);
+            int depth = 0, threads = 0;
+            sscanf(line + 5, "%d %d", &depth, &threads);
+            if (threads > 0) {
+                benchParallel(depth, threads, MB);
+            }
+            else {
+                bench(depth);
+            }
+            continue;
+        }
+        if (!strncmp(line, "farm", 4)) {
+            int games = 64, threads = std::thread::hardware_concurrency(), movetime = 50, plies = 10;
+            sscanf(line + 4, "%d %d %d %d", &games, &threads, &movetime, &plies);
+            farm(std::max(games, 1), std::max(threads, 0), std::max(movetime, 1), std::max(plies, 1), MB);
+            continue;
+        }
+        if (!strncmp(line, "epd ", 4)) {
+            analyseEpd(line + 4, MB);
+            continue;
+        }
+        if (!strncmp(line, "perft", 5)) {
+            int depth = 1, threads = std::thread::hardware_concurrency(), hashMB = 0;
+            sscanf(line + 5, "%d %d %d", &depth, &threads, &hashMB);
+            _engine.RunPerftTest(std::max(depth, 0), _board, std::max(threads, 1), std::max(hashMB, 0));
+            continue;
+        }
+        if (!strncmp(line, "hashstress", 10)) {
+            int threads = std::thread::hardware_concurrency(), seconds = 5;
+            sscanf(line + 10, "%d %d", &threads, &seconds);
+            stressHash(std::max(threads, 1), std::max(seconds, 1));
+            continue;
+        }
+        if (!strncmp(line, "savehash ", 9) || !strncmp(line, "loadhash ", 9)) {
+            std::string path(line + 9);
+            path.erase(path.find_last_not_of(" \r\n") + 1);
+
+            if (line[0] == 's') {
+                int start = GetTimeMs();
+                bool ok = _engine.Table->Save(path);
+                printf("info string %s hash to %s in %d ms\n", ok ? "saved" : "could not save", path.c_str(), GetTimeMs() - start);
+            }
+            else {
+                int start = GetTimeMs();
+                if (_engine.Table->Load(path)) {
+                    MB = (int)((_engine.Table->clusterCount * sizeof(TTCluster)) >> 20);
+                    printf("info string loaded %d MB of hash from %s in %d ms\n", MB, path.c_str(), GetTimeMs() - start);
+                }
+            }
+            continue;
+        }
+        if (!strncmp(line, "genbench", 8)) {
+            int passes = 100;
+            sscanf(line + 8, "%d", &passes);
+            benchMoveGen(std::max(passes, 1));
+            continue;
+        }
+        if (!strncmp(line, "hashbench", 9)) {
+            int maxMB = 1024, maxThreads = std::thread::hardware_concurrency();
+            sscanf(line + 9, "%d %d", &maxMB, &maxThreads);
+            benchHash(std::max(maxMB, 1), std::max(maxThreads, 1));
             continue;
         }
         else if (!strncmp(line, "position", 8)) {
+            _positionLine = line;
             ParsePos(line);
         }
         else if (!strncmp(line, "ucinewgame", 10)) {
             _engine.offset = 0;
-            _engine.Table.clear();
+            _engine.NewGame();
+            _cluster.Broadcast(line);
+            _positionLine = "position startpos";
             ParsePos("position startpos\n");
         }
         else if (!strncmp(line, "go", 2)) {
             printf("Seen Go..\n");
             ParseGo(line);
-            _engine.stop = false;
         }
         else if (!strncmp(line, "quit", 4)) {
             _engine.quit = true;
@@ -121,7 +260,39 @@ void UCIconnection::Loop() {
             if (MB < 4) MB = 4;
             if (MB > HASH_MAX) MB = HASH_MAX;
             printf("Set Hash to %d MB\n", MB);
-            _engine.Table.Resize(((1000000  )/ sizeof(THash)) * MB);
+            _engine.Table->Resize(MB);
+        }
+        else if (!strncmp(line, "setoption name Cluster value", 28)) {
+            std::string addresses(line + 28);
+            addresses.erase(0, addresses.find_first_not_of(" "));
+            addresses.erase(addresses.find_last_not_of(" \r\n") + 1);
+            if (addresses.empty() || addresses == "<empty>") {
+                _cluster.Disconnect();
+                printf("info string cluster off\n");
+            }
+            else {
+                _cluster.Connect(addresses);
+            }
+        }
+        else if (!strncmp(line, "setoption name EvalCache value ", 31)) {
+            int cacheMB = EVAL_CACHE_SIZE;
+            sscanf(line, "%*s %*s %*s %*s %d", &cacheMB);
+            cacheMB = std::clamp(cacheMB, 0, EVAL_CACHE_MAX);
+            printf("Set EvalCache to %d MB\n", cacheMB);
+            _engine.ResizeEvalCache(cacheMB);
+        }
+        else if (!strncmp(line, "setoption name MultiPV value ", 29)) {
+            int lines = 1;
+            sscanf(line, "%*s %*s %*s %*s %d", &lines);
+            _engine.multiPV = std::clamp(lines, 1, MULTIPV_MAX);
+            printf("Set MultiPV to %d\n", _engine.multiPV);
+        }
+        else if (!strncmp(line, "setoption name Threads value ", 29)) {
+            int threads = 1;
+            sscanf(line, "%*s %*s %*s %*s %d", &threads);
+            threads = std::clamp(threads, 1, THREADS_MAX);
+            printf("Set Threads to %d\n", threads);
+            _engine.SetThreads(threads);
         }
         if (_engine.quit) break;
     }
@@ -170,11 +341,15 @@ void UCIconnection::ParseGo(char* line) {
     int time = -1, inc = 0;
     char* ptr = NULL;
     _engine.maxTime = 1000000;
+    _engine.maxNodes = 0;
 
     if ((ptr = strstr(line, "infinite"))) {
-        ;
+        _engine.maxTime = std::numeric_limits<double>::infinity();
     }
 
+    // pondering searches without a limit, the time worked out below is what it gets after ponderhit
+    const bool ponder = strstr(line, "ponder") || strstr(line, "infinite");
+
     if ((ptr = strstr(line, "binc")) && _board.currentPlayer == BLACK) {
         inc = atoi(ptr + 5);
     }
@@ -202,6 +377,28 @@ void UCIconnection::ParseGo(char* line) {
     if ((ptr = strstr(line, "depth"))) {
         depth = atoi(ptr + 6);
     }
+    // go infinite and go ponder have no clock to stop them, in a simple position they would deepen past what the pv and killer tables hold
+    depth = std::min(depth, max_ply - 1);
+
+    if ((ptr = strstr(line, "nodes"))) {
+        _engine.maxNodes = atoll(ptr + 6);
+    }
+
+    // the moves of searchmoves run to the end of the line, anything that isn't a legal move is skipped
+    _engine.searchMoves = LegalMoves();
+    if ((ptr = strstr(line, "searchmoves"))) {
+        const LegalMoves legal = _board.GenerateLegalMoves(_board.currentPlayer);
+        std::istringstream iss(ptr + 11);
+        std::string token;
+
+        while (iss >> token) {
+            for (int i = 0; i < legal.count; i++) {
+                if (legal.moves[i].to_str() == token) {
+                    _engine.searchMoves.push_back(legal.moves[i]);
+                }
+            }
+        }
+    }
 
     if (movetime != -1) {
         time = movetime;
@@ -218,8 +415,28 @@ void UCIconnection::ParseGo(char* line) {
 
     printf("time:%d start:%d stop:%d depth:%d timeset:%d\n",
         time, _engine.startTime, _engine.maxTime, depth, (_engine.maxTime != 1000000));
-    _engine.BestMove(depth,_board);
-    _engine.offset++;
+    // the search runs next to the input loop so stop, isready and quit are read while it thinks
+    _engine.stop = false;
+    _engine.ponder = ponder;
+    if (_cluster.Active()) {
+        _searchThread = std::thread([this, go = std::string(line), board = _board] {
+            _cluster.Search(_positionLine, go, board, _engine.stop);
+            _engine.offset++;
+        });
+        return;
+    }
+    _searchThread = std::thread([this, depth, board = _board] {
+        _engine.BestMove(depth, board);
+        _engine.offset++;
+    });
+}
+
+
+void UCIconnection::stopSearch() {
+    if (_searchThread.joinable()) {
+        _engine.Stop();
+        _searchThread.join();
+    }
 }
 
 Move UCIconnection::ParseMove(const std::string& moveString) {
@@ -329,13 +546,17 @@ void UCIconnection::bench(int depth) {
     uint64_t nodes = 0;
     uint64_t count = 0;
     uint64_t time_elapsed = 0;
+    uint64_t evalProbes = 0;
+    uint64_t evalHits = 0;
 
     Board board;
 
     // Inspired from Koivisto
 
     _engine.maxTime = 100000000;
-    _engine.Table.clear();
+    _engine.Table->clear();
+    _engine.evalCache.clear();
+    _engine.NewGame();
 
     auto start = GetTimeMs();
     _engine.startTime = start;
@@ -343,16 +564,20 @@ void UCIconnection::bench(int depth) {
     auto end = GetTimeMs();
 
     count++;
-    nodes += _engine.count;
+    nodes += _engine.NodesSearched();
     time_elapsed += (end - start);
+    evalProbes += _engine.evalCache.probes;
+    evalHits += _engine.evalCache.hits;
 
-    printf("Position [%2d] -> bestmove %s %12ld nodes %8d nps", int(count),
+    printf("Position [%2d] -> bestmove %s %12ld nodes %8d nps %5.1f%% evalcache hits", int(count),
         bestmove.to_str().c_str(), nodes,
-        static_cast<int>(1000.0f * nodes / (time_elapsed + 1)));
+        static_cast<int>(1000.0f * nodes / (time_elapsed + 1)), _engine.evalCache.HitRate() / 10.0);
     std::cout << std::endl;
 
     for (auto& fen : bench_fens) {
-        _engine.Table.clear();
+        _engine.Table->clear();
+        _engine.evalCache.clear();
+        _engine.NewGame();
         board.ParseFen(fen);
 
         auto start = GetTimeMs();
@@ -361,16 +586,622 @@ void UCIconnection::bench(int depth) {
         auto end = GetTimeMs();
 
         count++;
-        nodes += _engine.count;
+        nodes += _engine.NodesSearched();
         time_elapsed += (end - start);
+        evalProbes += _engine.evalCache.probes;
+        evalHits += _engine.evalCache.hits;
 
-        printf("Position [%2d] -> bestmove %s %12ld nodes %8d nps", int(count),
+        printf("Position [%2d] -> bestmove %s %12ld nodes %8d nps %5.1f%% evalcache hits", int(count),
             bestmove.to_str().c_str(), nodes,
-            static_cast<int>(1000.0f * nodes / (time_elapsed + 1)));
+            static_cast<int>(1000.0f * nodes / (time_elapsed + 1)), _engine.evalCache.HitRate() / 10.0);
         std::cout << std::endl;
     }
 
-    printf("Finished: %42d nodes %8d nps\n", static_cast<int>(nodes),
-        static_cast<int>(1000.0f * nodes / (time_elapsed + 1)));
+    printf("Finished: %42d nodes %8d nps %5.1f%% evalcache hits\n", static_cast<int>(nodes),
+        static_cast<int>(1000.0f * nodes / (time_elapsed + 1)), evalProbes ? 100.0 * evalHits / evalProbes : 0.0);
     std::cout << std::flush;
-}
\ No newline at end of file
+}
+
+
+// every position on its own engine with its own table, as many at once as there are threads.
+// each search is the same as in the plain bench, so the node total has to match it
+void UCIconnection::benchParallel(int depth, int threads, int hashMB) {
+    struct BenchResult {
+        Move bestmove;
+        uint64_t nodes;
+        int time;
+    };
+
+    std::vector<std::string> fens = { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" };
+    fens.insert(fens.end(), std::begin(bench_fens), std::end(bench_fens));
+
+    std::vector<BenchResult> results(fens.size());
+    std::atomic<size_t> nextPosition(0);
+
+    auto work = [&]() {
+        ChessEngine engine(std::make_shared<TTable>(hashMB, 1));
+        engine.silent = true;
+        engine.maxTime = 100000000;
+
+        for (size_t i = nextPosition++; i < fens.size(); i = nextPosition++) {
+            Board board(fens[i]);
+
+            engine.Table->clear();
+            engine.NewGame();
+
+            auto start = GetTimeMs();
+            engine.startTime = start;
+            results[i].bestmove = engine.BestMove(depth, board);
+            results[i].time = GetTimeMs() - start;
+            results[i].nodes = engine.NodesSearched();
+        }
+    };
+
+    auto start = GetTimeMs();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    auto wall = GetTimeMs() - start;
+
+    uint64_t nodes = 0;
+    uint64_t searchTime = 0;
+
+    for (size_t i = 0; i < results.size(); i++) {
+        nodes += results[i].nodes;
+        searchTime += results[i].time;
+
+        printf("Position [%2d] -> bestmove %s %12llu nodes %8d nps\n", int(i + 1),
+            results[i].bestmove.to_str().c_str(), (unsigned long long)results[i].nodes,
+            static_cast<int>(1000.0f * results[i].nodes / (results[i].time + 1)));
+    }
+
+    // the thread nps is what one core does, the total nps what the machine does
+    printf("Finished: %42llu nodes %8d nps %8d nps per thread %8d ms wall %d threads\n", (unsigned long long)nodes,
+        static_cast<int>(1000.0f * nodes / (wall + 1)), static_cast<int>(1000.0f * nodes / (searchTime + 1)), int(wall), threads);
+    std::cout << std::flush;
+}
+
+
+// farm <games> <threads> <movetime> <plies>
+// plays that many games of the engine against itself at once, plies moves each with movetime ms of search
+// per move. the searches are multiplexed onto the threads by the scheduler, threads 0 gives every game an
+// os thread of its own to compare against. all games share one table of the hash size
+void UCIconnection::farm(int games, int threads, int movetime, int plies, int hashMB) {
+    struct GameRecord {
+        int moves;
+        uint64_t nodes;
+        std::vector<int> replies;
+        std::vector<int> waits;
+    };
+
+    auto table = std::make_shared<TTable>(hashMB, 1);
+    std::vector<std::unique_ptr<ScheduledGame>> farm;
+    std::vector<GameRecord> records(games);
+
+    for (int i = 0; i < games; i++) {
+        farm.push_back(std::make_unique<ScheduledGame>(table));
+        farm[i]->board.ParseFen(bench_fens[i % std::size(bench_fens)]);
+        farm[i]->budgetMs = movetime;
+        records[i] = { 0, 0, {}, {} };
+    }
+
+    // books the search that just finished and plays its move, false once the game is over
+    auto playMove = [&](ScheduledGame* game, int index) {
+        GameRecord& record = records[index];
+        record.moves++;
+        record.nodes += game->engine.NodesSearched();
+        record.replies.push_back(game->doneTime - game->submitTime);
+        record.waits.push_back(game->firstRunTime - game->submitTime);
+
+        if (game->bestMove == Move() || record.moves >= plies) {
+            return false;
+        }
+        game->board.MakeMove(game->bestMove);
+        return true;
+    };
+
+    uint64_t switches = 0;
+    auto start = GetTimeMs();
+
+    if (threads > 0) {
+        SearchScheduler scheduler(threads);
+
+        // every game resubmits itself from its done until it is over
+        std::vector<std::function<void(ScheduledGame*)>> next(games);
+        for (int i = 0; i < games; i++) {
+            next[i] = [&, i](ScheduledGame* game) {
+                if (playMove(game, i)) {
+                    scheduler.Submit(game, next[i]);
+                }
+            };
+            scheduler.Submit(farm[i].get(), next[i]);
+        }
+        scheduler.WaitIdle();
+        switches = scheduler.Switches();
+    }
+    else {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < games; i++) {
+            workers.emplace_back([&, i] {
+                ScheduledGame* game = farm[i].get();
+                do {
+                    game->submitTime = game->firstRunTime = GetTimeMs();
+                    game->engine.stop = false;
+                    game->engine.maxTime = movetime;
+                    game->engine.startTime = game->submitTime;
+                    game->bestMove = game->engine.BestMove(game->depth, game->board);
+                    game->doneTime = GetTimeMs();
+                } while (playMove(game, i));
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    auto wall = GetTimeMs() - start;
+
+    uint64_t nodes = 0;
+    double nodeSquares = 0;
+    int moves = 0;
+    std::vector<int> replies, waits;
+    for (auto& record : records) {
+        moves += record.moves;
+        nodes += record.nodes;
+        nodeSquares += double(record.nodes) * record.nodes;
+        replies.insert(replies.end(), record.replies.begin(), record.replies.end());
+        waits.insert(waits.end(), record.waits.begin(), record.waits.end());
+    }
+    std::sort(replies.begin(), replies.end());
+    std::sort(waits.begin(), waits.end());
+
+    auto average = [](const std::vector<int>& values) {
+        return values.empty() ? 0.0 : double(std::accumulate(values.begin(), values.end(), 0LL)) / values.size();
+    };
+
+    // jain's index over the nodes each game got, 1 when every game got the same work done
+    const double fairness = nodeSquares > 0 ? double(nodes) * nodes / games / nodeSquares : 1.0;
+
+    printf("Farm: %d games %d threads %d moves %llu nodes %8d nps %8.1f moves/s %8d ms wall\n", games, threads, moves,
+        (unsigned long long)nodes, static_cast<int>(1000.0f * nodes / (wall + 1)), 1000.0 * moves / (wall + 1), int(wall));
+    printf("Reply: %.1f ms average %d ms p99 %d ms max for a budget of %d ms, waited %.1f ms average %d ms max for a thread\n",
+        average(replies), replies[replies.size() * 99 / 100], replies.back(), movetime, average(waits), waits.back());
+    printf("Fairness: %.3f over the nodes per game, %llu switches\n", fairness, (unsigned long long)switches);
+    std::cout << std::flush;
+}
+
+
+// what is wrong with the position of an epd record, null when it can be searched. the search
+// takes a board with one king a side and every square accounted for
+static const char* epdError(const std::string& placement, const std::string& side, const std::string& enPassant) {
+    int ranks = 1, file = 0, whiteKings = 0, blackKings = 0;
+
+    for (char c : placement) {
+        if (c == '/') {
+            if (file != 8) {
+                return "bad rank";
+            }
+            ranks++;
+            file = 0;
+        }
+        else if (c >= '1' && c <= '8') {
+            file += c - '0';
+        }
+        else if (strchr("pnbrqkPNBRQK", c)) {
+            whiteKings += c == 'K';
+            blackKings += c == 'k';
+            file++;
+        }
+        else {
+            return "bad piece";
+        }
+
+        if (file > 8) {
+            return "bad rank";
+        }
+    }
+
+    if (ranks != 8 || file != 8) {
+        return "bad board";
+    }
+    if (whiteKings != 1 || blackKings != 1) {
+        return "needs one king a side";
+    }
+    if (side != "w" && side != "b") {
+        return "bad side to move";
+    }
+    if (enPassant != "-" && (enPassant.size() != 2 || enPassant[0] < 'a' || enPassant[0] > 'h' || (enPassant[1] != '3' && enPassant[1] != '6'))) {
+        return "bad en passant square";
+    }
+    return nullptr;
+}
+
+
+// epd <input> <output> [threads N] [depth N] [nodes N] [movetime N]
+// every line of the input is a fen or an epd record, the workers take them in turn with an engine
+// and table of their own. results are written in input order as the line followed by a tab and
+// bestmove, score, depth and nodes, the score is left out when the budget ran out
+// before a depth was through. the tables aren't cleared between positions, so results can
+// depend on which worker got which positions before
+void UCIconnection::analyseEpd(char* args, int hashMB) {
+    const char* usage = "info string usage: epd <input> <output> [threads N] [depth N] [nodes N] [movetime N]\n";
+
+    // the options are only looked for after the paths, a path may well have depth or nodes in it
+    std::istringstream tokens(args);
+    std::string inputPath, outputPath;
+    if (!(tokens >> inputPath >> outputPath)) {
+        printf("%s", usage);
+        return;
+    }
+
+    int threads = std::thread::hardware_concurrency(), depth = 0, movetime = 0;
+    int64_t nodes = 0;
+    std::string name;
+    long long value;
+
+    while (tokens >> name) {
+        if (!(tokens >> value)) {
+            printf("%s", usage);
+            return;
+        }
+
+        if (name == "threads") {
+            threads = (int)std::max(value, 1LL);
+        }
+        else if (name == "depth") {
+            depth = value;
+        }
+        else if (name == "nodes") {
+            nodes = value;
+        }
+        else if (name == "movetime") {
+            movetime = value;
+        }
+        else {
+            printf("%s", usage);
+            return;
+        }
+    }
+    if (!depth && !nodes && !movetime) {
+        depth = 8;
+    }
+
+    std::ifstream input(inputPath);
+    FILE* output = fopen(outputPath.c_str(), "w");
+    if (!input || !output) {
+        printf("info string can't open %s\n", !input ? inputPath.c_str() : outputPath.c_str());
+        if (output) {
+            fclose(output);
+        }
+        return;
+    }
+
+    // lines are read one at a time as the workers ask for them, a result waits in pending
+    // until every line before it has been written
+    std::mutex inputLock, outputLock;
+    size_t nextLine = 0, nextWrite = 0;
+    std::map<size_t, std::string> pending;
+
+    auto start = GetTimeMs();
+
+    auto work = [&]() {
+        ChessEngine engine(std::make_shared<TTable>(hashMB, 1));
+        engine.silent = true;
+
+        std::string line;
+        while (true) {
+            size_t index;
+            {
+                std::lock_guard<std::mutex> lock(inputLock);
+                if (!std::getline(input, line)) {
+                    break;
+                }
+                index = nextLine++;
+            }
+
+            line.erase(line.find_last_not_of(" \r\n") + 1);
+
+            std::string result;
+            std::istringstream fields(line);
+            std::string board, side, castle, enPassant;
+
+            if (fields >> board >> side >> castle >> enPassant) {
+                // a record that can't be searched is written back as it was with the reason, nothing
+                // thrown in here may leave the thread or it takes the whole engine down
+                const char* error = epdError(board, side, enPassant);
+                try {
+                    if (!error) {
+                        // an epd record has no move counters, they don't matter to the search
+                        Board position(board + " " + side + " " + castle + " " + enPassant + " 0 1");
+
+                        engine.NewGame();
+                        engine.maxTime = movetime ? movetime : std::numeric_limits<double>::infinity();
+                        engine.maxNodes = nodes;
+                        engine.startTime = GetTimeMs();
+
+                        Move bestmove = engine.BestMove(depth ? depth : max_ply - 1, position);
+
+                        char text[128];
+                        // no legal move, nothing was searched and the engine still holds the results of the record before
+                        if (bestmove == Move()) {
+                            snprintf(text, sizeof(text), "\tbestmove 0000 score %s 0 depth 0 nodes 0", position.isKingAttacked(position.currentPlayer) ? "mate" : "cp");
+                        }
+                        // stopped before depth 1 was through, bestScore is still the one of the record before
+                        else if (!engine.completedDepth) {
+                            snprintf(text, sizeof(text), "\tbestmove %s depth 0 nodes %lld", bestmove.to_str().c_str(), (long long)engine.NodesSearched());
+                        }
+                        else {
+                            // scored the way the info lines of a search are
+                            const int mate = ChessEngine::MateMoves(engine.bestScore, engine.completedDepth);
+                            snprintf(text, sizeof(text), "\tbestmove %s score %s %d depth %d nodes %lld", bestmove.to_str().c_str(),
+                                mate ? "mate" : "cp", mate ? mate : engine.bestScore, engine.completedDepth, (long long)engine.NodesSearched());
+                        }
+                        result = line + text;
+                    }
+                }
+                catch (const std::exception&) {
+                    error = "bad record";
+                }
+
+                if (error) {
+                    result = line + "\terror " + error;
+                }
+            }
+            else {
+                result = line;
+            }
+
+            std::lock_guard<std::mutex> lock(outputLock);
+            pending[index] = result;
+
+            while (!pending.empty() && pending.begin()->first == nextWrite) {
+                fprintf(output, "%s\n", pending.begin()->second.c_str());
+                pending.erase(pending.begin());
+                nextWrite++;
+
+                if (nextWrite % 1000 == 0) {
+                    printf("info string %llu positions %d positions per second\n", (unsigned long long)nextWrite,
+                        static_cast<int>(1000.0f * nextWrite / (GetTimeMs() - start + 1)));
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    fclose(output);
+
+    auto elapsed = GetTimeMs() - start;
+    printf("info string analysed %llu positions in %d ms, %d positions per second\n", (unsigned long long)nextWrite, int(elapsed),
+        static_cast<int>(1000.0f * nextWrite / (elapsed + 1)));
+}
+
+
+void UCIconnection::stressHash(int threads, int seconds) {
+
+    struct StressPosition {
+        Board board;
+        Move move;
+        int score;
+    };
+
+    // the smallest table there is, with far more positions than it has room for
+    TTable table(1);
+    std::vector<StressPosition> positions;
+    std::set<std::pair<size_t, uint16_t>> seen;
+    std::mt19937_64 rng(1);
+
+    // walk random games out of every bench position, every position gets one legal move
+    // and a score derived from its key. positions the table can't tell apart are skipped, so
+    // any hit that doesn't give back exactly what was stored for that key is a torn entry
+    for (size_t game = 0; game < 64 * std::size(bench_fens); game++) {
+        Board board(bench_fens[game % std::size(bench_fens)]);
+
+        for (int i = 0; i < 64; i++) {
+            LegalMoves legal = board.GenerateLegalMoves(board.currentPlayer);
+            if (legal.count == 0) {
+                break;
+            }
+
+            const Move move = legal.moves[rng() % legal.count];
+            if (seen.insert({ table.ClusterIndex(board.hashKey), uint16_t(board.hashKey & 0xffff) }).second) {
+                positions.push_back({ board, move, int(board.hashKey % 2001) - 1000 });
+            }
+            board.MakeMove(move);
+        }
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> probes(0), hits(0), writes(0), corrupted(0);
+
+    auto worker = [&](int id) {
+        std::mt19937_64 rng(id + 1);
+        uint64_t localProbes = 0, localHits = 0, localWrites = 0, localCorrupted = 0;
+
+        while (!done.load(std::memory_order_relaxed)) {
+            const StressPosition& pos = positions[rng() % positions.size()];
+
+            if (rng() & 1) {
+                table.WriteHash(pos.board.hashKey, pos.score, 1 + rng() % 64, pos.move, static_cast<HashFlags>(rng() % 3), 0);
+                localWrites++;
+                continue;
+            }
+
+            THash entry;
+            localProbes++;
+            if (!table.ProbeHash(pos.board.hashKey, &entry, 0)) {
+                continue;
+            }
+            localHits++;
+
+            if (entry.bestMove != pos.move || entry.score != pos.score) {
+                LegalMoves legal = pos.board.GenerateLegalMoves(pos.board.currentPlayer);
+                bool isLegal = std::find(legal.moves, legal.moves + legal.count, entry.bestMove) != legal.moves + legal.count;
+                printf("corrupted entry: move %s (%s) score %d, expected %s score %d\n", entry.bestMove.to_str().c_str(),
+                    isLegal ? "legal" : "illegal", entry.score, pos.move.to_str().c_str(), pos.score);
+                localCorrupted++;
+            }
+        }
+
+        probes += localProbes;
+        hits += localHits;
+        writes += localWrites;
+        corrupted += localCorrupted;
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(worker, i);
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    done = true;
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    printf("Hash stress: %d threads %d positions %llu probes %llu hits %llu writes %llu corrupted -> %s\n",
+        threads, int(positions.size()), (unsigned long long)probes, (unsigned long long)hits,
+        (unsigned long long)writes, (unsigned long long)corrupted, corrupted ? "FAILED" : "ok");
+    std::cout << std::flush;
+}
+
+
+void UCIconnection::benchHash(int maxMB, int maxThreads) {
+
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    // allocation includes first touching every page with all threads, after that
+    // the clear times are for a table that is already faulted in
+    for (int mb = 16; mb <= maxMB; mb *= 4) {
+        int start = GetTimeMs();
+        TTable table(mb, maxThreads);
+        printf("Hash %7d MB: alloc %6d ms |", mb, GetTimeMs() - start);
+
+        for (int threads : threadCounts) {
+            table.clearThreads = threads;
+
+            start = GetTimeMs();
+            table.clear();
+            printf(" clear %3d threads %6d ms", threads, GetTimeMs() - start);
+        }
+        std::cout << std::endl;
+    }
+}
+
+
+// genbench <passes>
+// how fast positions walked out of the bench set are generated and played, nothing is searched.
+// every part runs over all positions passes times
+void UCIconnection::benchMoveGen(int passes) {
+    std::vector<Board> positions;
+    std::vector<LegalMoves> legal;
+    std::mt19937_64 rng(1);
+
+    for (size_t game = 0; game < 16 * std::size(bench_fens); game++) {
+        Board board(bench_fens[game % std::size(bench_fens)]);
+
+        for (int i = 0; i < 32; i++) {
+            LegalMoves moves = board.GenerateLegalMoves(board.currentPlayer);
+            if (moves.count == 0) {
+                break;
+            }
+            positions.push_back(board);
+            legal.push_back(moves);
+            board.MakeMove(moves.moves[rng() % moves.count]);
+        }
+    }
+
+    // the sum only keeps the compiler from dropping the work
+    uint64_t sum = 0;
+
+    auto measure = [&](const char* name, auto work) {
+        uint64_t items = 0;
+        const int start = GetTimeMs();
+        for (int pass = 0; pass < passes; pass++) {
+            for (size_t i = 0; i < positions.size(); i++) {
+                items += work(i);
+            }
+        }
+        const int elapsed = std::max(GetTimeMs() - start, 1);
+        printf("Movegen %-10s %6d ms %8.2f M positions/s %8.2f M items/s\n", name, elapsed,
+            positions.size() * (double)passes / elapsed / 1000, items / (double)elapsed / 1000);
+    };
+
+#ifdef USE_PEXT
+    const char* sliders = "pext";
+#else
+    const char* sliders = "magic";
+#endif
+    printf("Movegen over %d positions, %d passes, %s slider lookups\n", int(positions.size()), passes, sliders);
+
+    measure("legal", [&](size_t i) {
+        const LegalMoves moves = positions[i].GenerateLegalMoves(positions[i].currentPlayer);
+        sum += moves.moves[0].getPacked();
+        return moves.count;
+    });
+    measure("captures", [&](size_t i) {
+        const LegalMoves moves = positions[i].GenerateCaptureMoves(positions[i].currentPlayer);
+        sum += moves.moves[0].getPacked();
+        return moves.count;
+    });
+    measure("make", [&](size_t i) {
+        for (int m = 0; m < legal[i].count; m++) {
+            Board next = positions[i];
+            next.MakeMove(legal[i].moves[m]);
+            sum += next.hashKey;
+        }
+        return legal[i].count;
+    });
+    measure("getpiece", [&](size_t i) {
+        for (int square = 0; square < 64; square++) {
+            sum += positions[i].getPiece(square);
+        }
+        return 64;
+    });
+    measure("hashkey", [&](size_t i) {
+        sum += positions[i].generateHashKey();
+        return 1;
+    });
+    // a slider lookup from every square with the blockers of the position, the part pext or the magics decide
+    std::vector<uint64_t> occupancies(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        for (int square = 0; square < 64; square++) {
+            occupancies[i] |= uint64_t(positions[i].isSquareOccupied(square)) << square;
+        }
+    }
+    measure("bishop", [&](size_t i) {
+        const uint64_t occupancy = occupancies[i];
+        for (int square = 0; square < 64; square++) {
+            sum += Masks::bishopAttacksFrom(square, occupancy);
+        }
+        return 64;
+    });
+    measure("rook", [&](size_t i) {
+        const uint64_t occupancy = occupancies[i];
+        for (int square = 0; square < 64; square++) {
+            sum += Masks::rookAttacksFrom(square, occupancy);
+        }
+        return 64;
+    });
+
+    printf("Movegen checksum %llu\n", (unsigned long long)sum);
+    std::cout << std::flush;
+}
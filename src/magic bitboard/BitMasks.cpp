@@ -113,6 +113,37 @@ void Masks::generateRookBitmasks() {
 
 
 
+void Masks::generateLineBitmasks() {
+    for (int from = 0; from < 64; from++) {
+        for (int to = 0; to < 64; to++) {
+            between[from][to] = 0;
+            line[from][to] = 0;
+
+            const int rankDelta = to / 8 - from / 8;
+            const int fileDelta = to % 8 - from % 8;
+            if (from == to || (rankDelta && fileDelta && std::abs(rankDelta) != std::abs(fileDelta))) {
+                continue;
+            }
+
+            const int rankStep = (rankDelta > 0) - (rankDelta < 0);
+            const int fileStep = (fileDelta > 0) - (fileDelta < 0);
+
+            for (int r = from / 8 + rankStep, f = from % 8 + fileStep; r * 8 + f != to; r += rankStep, f += fileStep) {
+                between[from][to] |= 1ULL << (r * 8 + f);
+            }
+
+            // walk from the first square to both edges
+            line[from][to] = 1ULL << from;
+            for (int sign = -1; sign <= 1; sign += 2) {
+                for (int r = from / 8 + sign * rankStep, f = from % 8 + sign * fileStep; r >= 0 && r < 8 && f >= 0 && f < 8; r += sign * rankStep, f += sign * fileStep) {
+                    line[from][to] |= 1ULL << (r * 8 + f);
+                }
+            }
+        }
+    }
+}
+
+
 uint64_t Masks::getBishopAttacks(int square, uint64_t occupancy) {
     // result attacks Masks
     uint64_t attacks = 0ULL;
@@ -174,11 +205,11 @@ void Masks::generateBishopAttacks() {
         uint64_t mask = bishopMasks[square];
         int numbits = countBits(mask);
         int numOccupancies = 1 << numbits;
-
+        bishopShift[square] = 64 - numbits;
 
         for (int i = 0; i < numOccupancies; ++i) {
-            uint64_t magic = (setOccupancy(square,i,mask) * bishopMagic[square]) >> (64 - numbits);
-            bishopAttacks[square][magic] = getBishopAttacks(square, setOccupancy(square, i  , mask));
+            uint64_t occupancy = setOccupancy(square, i, mask);
+            bishopAttacks[square][bishopIndex(square, occupancy)] = getBishopAttacks(square, occupancy);
         }
     }
 }
@@ -231,16 +262,15 @@ uint64_t Masks::getRookAttacks(int square, uint64_t occupancy) {
 }
 
 void Masks::generateRookAttacks() {
-
     for (int square = 0; square < 64; ++square) {
         uint64_t mask = rookMasks[square];
         int numbits = countBits(mask);
         int numOccupancies = 1 << numbits;
-
+        rookShift[square] = 64 - numbits;
 
         for (int i = 0; i < numOccupancies; ++i) {
-            uint64_t magic = (setOccupancy(square, i, mask) * rookMagic[square]) >> (64 - numbits);
-            rookAttacks[square][magic] = getRookAttacks(square, setOccupancy(square, i, mask));
+            uint64_t occupancy = setOccupancy(square, i, mask);
+            rookAttacks[square][rookIndex(square, occupancy)] = getRookAttacks(square, occupancy);
         }
     }
 }
@@ -352,6 +382,32 @@ void Masks::generateHashKeys() {
     SideKey = random_uint64();
 }
 
+uint64_t Masks::hashKeySignature() {
+    uint64_t signature = 0xcbf29ce484222325ULL;
+
+    auto mix = [&signature](uint64_t key) {
+        signature = (signature ^ key) * 0x100000001b3ULL;
+        signature ^= signature >> 29;
+    };
+
+    for (int i = 0; i < 12; i++) {
+        for (int j = 0; j < 64; j++) {
+            mix(pieceKeys[i][j]);
+        }
+    }
+
+    for (int i = 0; i < 64; i++) {
+        mix(enPeasentKeys[i]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        mix(CastleKeys[i]);
+    }
+
+    mix(SideKey);
+    return signature;
+}
+
 
 // Initialize static member variables 
 uint64_t Masks::bishopMasks[64];
@@ -497,5 +553,11 @@ uint64_t Masks::CastleKeys[16] = { 0 };
 
 uint64_t Masks::SideKey = { 0 };
 
+int Masks::bishopShift[64];
+int Masks::rookShift[64];
+
 uint64_t Masks::bishopAttacks[64][512];
-uint64_t Masks::rookAttacks[64][4096];
\ No newline at end of file
+uint64_t Masks::rookAttacks[64][4096];
+
+uint64_t Masks::between[64][64];
+uint64_t Masks::line[64][64];
\ No newline at end of file
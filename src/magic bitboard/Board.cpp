@@ -115,6 +115,8 @@ void Board::ParseFen(const std::string& fen) {
         currentPlayer = WHITE,
         castleFlags = 0;
 
+    std::fill(mailbox, mailbox + 64, EMPTY);
+
     std::istringstream iss(fen);
     std::string token;
 
@@ -174,7 +176,7 @@ void Board::ParseFen(const std::string& fen) {
     if (!std::getline(iss, token, ' '))
         return;  // FEN is invalid or incomplete
 
-    enPassantSquare = (token == "-") ? ' ' : token[0];
+    enPassantSquare = (token == "-" || token.size() < 2) ? -1 : (token[0] - 'a') + 8 * (token[1] - '1');
 
     // Parse the halfmove clock field
     if (!std::getline(iss, token, ' '))
@@ -189,6 +191,7 @@ void Board::ParseFen(const std::string& fen) {
     fullMoveNumber = std::stoi(token);
 
     hashKey = generateHashKey();
+    pawnKey = generatePawnKey();
 
     eval = SlowEval();
 }
@@ -201,7 +204,7 @@ void Board::getBoard(int board[64]) {
     for (int square = 0; square < 64; ++square) {
         if (isSquareOccupied(square)) {
             Piece piece = getPiece(square);
-            Color color = (getWhitePiece(piece) & (1ULL << square)) != 0 ? WHITE : BLACK;
+            Color color = (whitePieces & (1ULL << square)) != 0 ? WHITE : BLACK;
             int value = (color == WHITE) ? static_cast<int>(piece) : -static_cast<int>(piece);
             board[square] = value;
         }
@@ -210,22 +213,22 @@ void Board::getBoard(int board[64]) {
 
 
 void Board::clearSquare(uint32_t square) {
+    const Piece piece = getPiece(square);
+    if (piece == EMPTY) {
+        return;
+    }
+
     const uint64_t mask = ~(1ULL << square);
-    whitePawns &= mask;
-    whiteKnights &= mask;
-    whiteBishops &= mask;
-    whiteRooks &= mask;
-    whiteQueens &= mask;
-    whiteKing &= mask;
-    blackPawns &= mask;
-    blackKnights &= mask;
-    blackBishops &= mask;
-    blackRooks &= mask;
-    blackQueens &= mask;
-    blackKing &= mask;
-
-    whitePieces &= mask;
-    blackPieces &= mask;
+    if (whitePieces & ~mask) {
+        getWhitePiece(piece) &= mask;
+        whitePieces &= mask;
+    }
+    else {
+        getBlackPiece(piece) &= mask;
+        blackPieces &= mask;
+    }
+
+    mailbox[square] = EMPTY;
 }
 
 bool Board::isSquareOccupied(uint32_t square) const {
@@ -233,33 +236,6 @@ bool Board::isSquareOccupied(uint32_t square) const {
     return (blackPieces & mask) || (whitePieces & mask);
 }
 
-Piece Board::getPiece(uint32_t square) const {
-    const uint64_t mask = 1ULL << square;
-
-    if ((whitePawns | blackPawns) & mask) {
-        return PAWN;
-    }
-    else if ((whiteKnights | blackKnights) & mask) {
-        return KNIGHT;
-    }
-    else if ((whiteBishops | blackBishops) & mask) {
-        return BISHOP;
-    }
-    else if ((whiteRooks | blackRooks) & mask) {
-        return ROOK;
-    }
-    else if ((whiteQueens | blackQueens) & mask) {
-        return QUEEN;
-    }
-    else if ((whiteKing | blackKing) & mask) {
-        return KING;
-    }
-    else {
-        return EMPTY;
-    }
-}
-
-
 uint64_t& Board::getWhitePiece(Piece piece) {
     switch (piece) {
     case PAWN: return whitePawns;
@@ -287,6 +263,7 @@ uint64_t& Board::getBlackPiece(Piece piece) {
 void inline Board::setSquare(uint32_t square, Color color, Piece piece) {
     ((color == WHITE) ? getWhitePiece(piece) : getBlackPiece(piece)) |= 1ULL << square;
     ((color == WHITE) ? whitePieces : blackPieces) |= 1ULL << square;
+    mailbox[square] = piece;
 }
 
 bool Board::isOccupiedByColor(std::int32_t square, Color color) const {
@@ -325,42 +302,56 @@ void Board::MakeNullMove() {
 }
 
 void Board::MakeMove(const Move& move) {
+    if (move.getColor() == WHITE) {
+        makeMove<WHITE>(move);
+    }
+    else {
+        makeMove<BLACK>(move);
+    }
+}
+
+template<Color Us>
+void Board::makeMove(const Move& move) {
     const unsigned int to = move.getTo();
     const unsigned int from = move.getFrom();
-    const Color color = move.getColor();
     const Piece piece = move.getPiece();
     const Piece capture = move.getCapturedPiece();
     const unsigned int flags = move.getFlags();
 
     clearSquare(to);
-    setSquare(to, color, piece);
+    setSquare(to, Us, piece);
     clearSquare(from);
 
 
     if (capture != EMPTY) {
-        hashKey ^= Masks::pieceKeys[6 * color + capture - 1][to];
+        hashKey ^= Masks::pieceKeys[6 * Us + capture - 1][to];
     }
 
-    hashKey ^= Masks::pieceKeys[6 * !color + piece - 1][to];
+    if (capture == PAWN) {
+        pawnKey ^= Masks::pieceKeys[6 * Us + PAWN - 1][to];
+    }
+
+    hashKey ^= Masks::pieceKeys[6 * !Us + piece - 1][to];
 
     if (flags == PROMOTE) {
-        hashKey ^= Masks::pieceKeys[6 * !color + PAWN - 1][from];
+        hashKey ^= Masks::pieceKeys[6 * !Us + PAWN - 1][from];
+        pawnKey ^= Masks::pieceKeys[6 * !Us + PAWN - 1][from];
 
-        eval -= pawn_score[from ^ (56 * color)];
+        eval -= pawn_score[from ^ (56 * Us)];
         eval -= 100;
 
         switch (piece) {
         case KNIGHT:
             eval += 300;
-            eval += knight_score[to ^ (56 * color)];
+            eval += knight_score[to ^ (56 * Us)];
             break;
         case BISHOP:
             eval += 325;
-            eval += bishop_score[to ^ (56 * color)];
+            eval += bishop_score[to ^ (56 * Us)];
             break;
         case ROOK:
             eval += 500;
-            eval += rook_score[to ^ (56 * color)];
+            eval += rook_score[to ^ (56 * Us)];
             break;
         case QUEEN:
             eval += 900;
@@ -368,28 +359,31 @@ void Board::MakeMove(const Move& move) {
         }
     }
     else {
-        hashKey ^= Masks::pieceKeys[6 * !color + piece - 1][from];
+        hashKey ^= Masks::pieceKeys[6 * !Us + piece - 1][from];
 
         switch (piece) {
         case PAWN:
-            eval -= pawn_score[from ^ (56 * color)];
-            eval += pawn_score[to ^ (56 * color)];
+            eval -= pawn_score[from ^ (56 * Us)];
+            eval += pawn_score[to ^ (56 * Us)];
+
+            pawnKey ^= Masks::pieceKeys[6 * !Us + PAWN - 1][from];
+            pawnKey ^= Masks::pieceKeys[6 * !Us + PAWN - 1][to];
             break;
         case KNIGHT:
-            eval -= knight_score[from ^ (56 * color)];
-            eval += knight_score[to ^ (56 * color)];
+            eval -= knight_score[from ^ (56 * Us)];
+            eval += knight_score[to ^ (56 * Us)];
             break;
         case BISHOP:
-            eval -= bishop_score[from ^ (56 * color)];
-            eval += bishop_score[to ^ (56 * color)];
+            eval -= bishop_score[from ^ (56 * Us)];
+            eval += bishop_score[to ^ (56 * Us)];
             break;
         case ROOK:
-            eval -= rook_score[from ^ (56 * color)];
-            eval += rook_score[to ^ (56 * color)];
+            eval -= rook_score[from ^ (56 * Us)];
+            eval += rook_score[to ^ (56 * Us)];
             break;
         case KING:
-            eval -= king_score[from ^ (56 * color)];
-            eval += king_score[to ^ (56 * color)];
+            eval -= king_score[from ^ (56 * Us)];
+            eval += king_score[to ^ (56 * Us)];
             break;
         }   
     }
@@ -398,19 +392,19 @@ void Board::MakeMove(const Move& move) {
 
     switch (capture) {
     case PAWN:
-        eval += pawn_score[(to ^ (56 * !color))];
+        eval += pawn_score[(to ^ (56 * !Us))];
         eval += 100;
         break;
     case KNIGHT:
-        eval += knight_score[to ^ (56 * !color)];
+        eval += knight_score[to ^ (56 * !Us)];
         eval += 300;
         break;
     case BISHOP:
-        eval += bishop_score[to ^ (56 * !color)];
+        eval += bishop_score[to ^ (56 * !Us)];
         eval += 325;
         break;
     case ROOK:
-        eval += rook_score[to ^ (56 * !color)];
+        eval += rook_score[to ^ (56 * !Us)];
         eval += 500;
         break;
     case QUEEN:
@@ -428,32 +422,32 @@ void Board::MakeMove(const Move& move) {
     hashKey ^= Masks::CastleKeys[castleFlags];
 
     if (flags == KING_CASTLE) {
-        if (color == WHITE) {
+        if constexpr (Us == WHITE) {
             // Move the rook from H1 to F1
             const unsigned int rookFrom = 7;
             const unsigned int rookTo = 5;
             castleFlags &= ~(WHITE_KINGSIDE_CASTLING | WHITE_QUEENSIDE_CASTLING);
-            setSquare(rookTo, color, ROOK);
+            setSquare(rookTo, Us, ROOK);
             clearSquare(rookFrom);
 
-            eval -= rook_score[rookFrom ^ (56 * color)];
-            eval += rook_score[rookTo ^ (56 * color)];
+            eval -= rook_score[rookFrom ^ (56 * Us)];
+            eval += rook_score[rookTo ^ (56 * Us)];
 
             hashKey ^= Masks::pieceKeys[ROOK - 1][rookFrom];
 
             hashKey ^= Masks::pieceKeys[ROOK - 1][rookTo];
 
         }
-        else if (color == BLACK) {
+        else {
             // Move the rook from H8 to F8
             const unsigned int rookFrom = 63;
             const unsigned int rookTo = 61;
             castleFlags &= ~(BLACK_KINGSIDE_CASTLING | BLACK_QUEENSIDE_CASTLING);
-            setSquare(rookTo, color, ROOK);
+            setSquare(rookTo, Us, ROOK);
             clearSquare(rookFrom);
 
-            eval -= rook_score[rookFrom ^ (56 * color)];
-            eval += rook_score[rookTo ^ (56 * color)];
+            eval -= rook_score[rookFrom ^ (56 * Us)];
+            eval += rook_score[rookTo ^ (56 * Us)];
 
             hashKey ^= Masks::pieceKeys[6 + ROOK - 1][rookFrom];
 
@@ -461,32 +455,32 @@ void Board::MakeMove(const Move& move) {
         }
     }
     else if (flags == QUEEN_CASTLE) {
-        if (color == WHITE) {
+        if constexpr (Us == WHITE) {
             // Move the rook from A1 to D1
             const unsigned int rookFrom = 0;
             const unsigned int rookTo = 3;
             castleFlags &= ~(WHITE_KINGSIDE_CASTLING | WHITE_QUEENSIDE_CASTLING);
-            setSquare(rookTo, color, ROOK);
+            setSquare(rookTo, Us, ROOK);
             clearSquare(rookFrom);
 
-            eval -= rook_score[rookFrom ^ (56 * color)];
-            eval += rook_score[rookTo ^ (56 * color)];
+            eval -= rook_score[rookFrom ^ (56 * Us)];
+            eval += rook_score[rookTo ^ (56 * Us)];
 
             hashKey ^= Masks::pieceKeys[ROOK - 1][rookFrom];
 
             hashKey ^= Masks::pieceKeys[ROOK - 1][rookTo];
         }
-        else if (color == BLACK) {
+        else {
             // Move the rook from A8 to D8
             const unsigned int rookFrom = 56;
             const unsigned int rookTo = 59;
             castleFlags &= ~(BLACK_KINGSIDE_CASTLING | BLACK_QUEENSIDE_CASTLING);
 
-            setSquare(rookTo, color, ROOK);
+            setSquare(rookTo, Us, ROOK);
             clearSquare(rookFrom);
 
-            eval -= rook_score[rookFrom ^ (56 * color)];
-            eval += rook_score[rookTo ^ (56 * color)];
+            eval -= rook_score[rookFrom ^ (56 * Us)];
+            eval += rook_score[rookTo ^ (56 * Us)];
 
             hashKey ^= Masks::pieceKeys[6 + ROOK - 1][rookFrom];
 
@@ -496,7 +490,7 @@ void Board::MakeMove(const Move& move) {
 
     // Check for king's movement
     if (piece == KING) {
-        if (color == WHITE) {
+        if constexpr (Us == WHITE) {
             castleFlags &= ~WHITE_KINGSIDE_CASTLING;
             castleFlags &= ~WHITE_QUEENSIDE_CASTLING;
         }
@@ -508,7 +502,7 @@ void Board::MakeMove(const Move& move) {
 
     // Check for rook's movement or capture
     if (piece == ROOK) {
-        if (color == WHITE) {
+        if constexpr (Us == WHITE) {
             if (from == 0)
                 castleFlags &= ~WHITE_QUEENSIDE_CASTLING;
             else if (from == 7)
@@ -535,15 +529,18 @@ void Board::MakeMove(const Move& move) {
 
     // Handle en passant capture
     if (flags == EN_PASSANT_CAPTURE) {
-        const int capturedPawnSquare = to + (color == WHITE ? -8 : 8);
+        const int capturedPawnSquare = to + (Us == WHITE ? -8 : 8);
 
         clearSquare(capturedPawnSquare);
 
-        eval += pawn_score[capturedPawnSquare ^ ( 56 * !color)];
-        eval -= pawn_score[to ^ ( 56 * !color)];
+        eval += pawn_score[capturedPawnSquare ^ ( 56 * !Us)];
+        eval -= pawn_score[to ^ ( 56 * !Us)];
 
-        hashKey ^= Masks::pieceKeys[6 * color + PAWN - 1][to];
-        hashKey ^= Masks::pieceKeys[6 * color + PAWN - 1][capturedPawnSquare];
+        hashKey ^= Masks::pieceKeys[6 * Us + PAWN - 1][to];
+        hashKey ^= Masks::pieceKeys[6 * Us + PAWN - 1][capturedPawnSquare];
+
+        pawnKey ^= Masks::pieceKeys[6 * Us + PAWN - 1][to];
+        pawnKey ^= Masks::pieceKeys[6 * Us + PAWN - 1][capturedPawnSquare];
 
     }
 
@@ -556,7 +553,7 @@ void Board::MakeMove(const Move& move) {
     }
 
     // Update the fullMoveNumber
-    if (color == BLACK) {
+    if constexpr (Us == BLACK) {
         fullMoveNumber++;
     }
 
@@ -566,7 +563,7 @@ void Board::MakeMove(const Move& move) {
 
     // Update en passant square
     if (piece == PAWN && flags == DOUBLE_PUSH) {
-        const std::int32_t pawnDirection = (color == WHITE) ? 1 : -1;
+        const std::int32_t pawnDirection = (Us == WHITE) ? 1 : -1;
         enPassantSquare = to - (pawnDirection * 8);
         hashKey ^= Masks::enPeasentKeys[enPassantSquare];
     }
@@ -643,89 +640,74 @@ void Board::PrintBoard() const {
 
 
 LegalMoves Board::GenerateLegalMoves(Color color) const {
+    return color == WHITE ? generateLegalMoves<WHITE>() : generateLegalMoves<BLACK>();
+}
+
+LegalMoves Board::GenerateCaptureMoves(Color color) const {
+    return color == WHITE ? generateCaptureMoves<WHITE>() : generateCaptureMoves<BLACK>();
+}
+
+LegalMoves Board::GenerateQuietMoves(Color color) const {
+    return color == WHITE ? generateQuietMoves<WHITE>() : generateQuietMoves<BLACK>();
+}
+
+Move Board::LegalMove(Move move) const {
+    return currentPlayer == WHITE ? legalMove<WHITE>(move) : legalMove<BLACK>(move);
+}
+
+template<Color Us>
+LegalMoves Board::generateLegalMoves() const {
     LegalMoves legalMoves;
 
+    const MoveMasks masks = getMoveMasks<Us>();
+    const uint64_t occupancy = whitePieces | blackPieces;
 
-    generatePawnMoves(color, legalMoves);
+    generatePawnMoves<Us>(legalMoves, masks);
 
-    uint64_t knights = color == WHITE ? whiteKnights : blackKnights;
+    uint64_t knights = Us == WHITE ? whiteKnights : blackKnights;
 
     while (knights) {
         const int square = getLSB(knights);
 
-        generateNonSlidingMoves(square, legalMoves, Masks::knightAttack[square], KNIGHT);
+        generateNonSlidingMoves<Us>(square, legalMoves, Masks::knightAttack[square] & masks.targets(square), KNIGHT);
 
         // Clear the least significant bit of the current piece
         knights &= (knights - 1);
     }
 
-    {
-        constexpr uint64_t WHITE_KINGSIDE_EMPTY = 0x0000000000000060ULL;  // Squares f1 and g1 are empty
-        constexpr uint64_t BLACK_KINGSIDE_EMPTY = 0x6000000000000000ULL;  // Squares f8 and g8 are empty
-        constexpr uint64_t WHITE_QUEENSIDE_EMPTY = 0x000000000000000EULL;  // Squares b1, c1, and d1 are empty
-        constexpr uint64_t BLACK_QUEENSIDE_EMPTY = 0x0E00000000000000ULL;  // Squares b8, c8, and d8 are empty
-
-        uint64_t kings = color == WHITE ? whiteKing : blackKing;
-
-        const int square = getLSB(kings);
-
-        generateNonSlidingMoves(square, legalMoves, Masks::kingAttack[square], KING);
-
-        // Check if castling is allowed for the current color
-        const bool canCastleKingside = (castleFlags & (color == WHITE ? WHITE_KINGSIDE_CASTLING : BLACK_KINGSIDE_CASTLING)) != 0;
-        const bool canCastleQueenside = (castleFlags & (color == WHITE ? WHITE_QUEENSIDE_CASTLING : BLACK_QUEENSIDE_CASTLING)) != 0;
-
-        // Generate kingside castle move
-        if (canCastleKingside) {
-            // Check if the squares between the king and rook are unoccupied
-            const uint64_t kingsideEmpty = (color == WHITE) ? WHITE_KINGSIDE_EMPTY : BLACK_KINGSIDE_EMPTY;
-            if ((kingsideEmpty & (whitePieces | blackPieces)) == 0) {
-                const uint32_t target = (color == WHITE) ? 6 : 62;
-                legalMoves.emplace_back(square, target, KING_CASTLE, color, KING);
-            }
-        }
-
-        // Generate queenside castle move
-        if (canCastleQueenside) {
-            // Check if the squares between the king and rook are unoccupied
-            const uint64_t queensideEmpty = (color == WHITE) ? WHITE_QUEENSIDE_EMPTY : BLACK_QUEENSIDE_EMPTY;
-            if ((queensideEmpty & (whitePieces | blackPieces)) == 0) {
-                const uint32_t target = (color == WHITE) ? 2 : 58;
-                legalMoves.emplace_back(square, target, QUEEN_CASTLE, color, KING);
-            }
-        }
-    }
+    generateKingMoves<Us>(legalMoves, ~0ULL);
+    generateCastleMoves<Us>(legalMoves, masks);
 
-    uint64_t bishops = color == WHITE ? whiteBishops : blackBishops;
+    uint64_t bishops = Us == WHITE ? whiteBishops : blackBishops;
 
     while (bishops) {
         const int square = getLSB(bishops);
 
-        generateSlidingMoves(square, legalMoves, Masks::bishopMasks[square], Masks::bishopMagic[square], Masks::bishopAttacks[square], BISHOP);
+        generateSlidingMoves<Us>(square, legalMoves, Masks::bishopAttacksFrom(square, occupancy), BISHOP, masks.targets(square));
 
         // Clear the least significant bit of the current piece
         bishops &= (bishops - 1);
     }
 
-    uint64_t rooks = color == WHITE ? whiteRooks : blackRooks;
+    uint64_t rooks = Us == WHITE ? whiteRooks : blackRooks;
 
     while (rooks) {
         const int square = getLSB(rooks);
 
-        generateSlidingMoves(square, legalMoves, Masks::rookMasks[square], Masks::rookMagic[square], Masks::rookAttacks[square], ROOK);
+        generateSlidingMoves<Us>(square, legalMoves, Masks::rookAttacksFrom(square, occupancy), ROOK, masks.targets(square));
 
         // Clear the least significant bit of the current piece
         rooks &= (rooks - 1);
     }
 
-    uint64_t queens = color == WHITE ? whiteQueens : blackQueens;
+    uint64_t queens = Us == WHITE ? whiteQueens : blackQueens;
 
     while (queens) {
         const int square = getLSB(queens);
 
-        generateSlidingMoves(square, legalMoves, Masks::rookMasks[square], Masks::rookMagic[square], Masks::rookAttacks[square], QUEEN);
+        generateSlidingMoves<Us>(square, legalMoves, Masks::rookAttacksFrom(square, occupancy), QUEEN, masks.targets(square));
 
-        generateSlidingMoves(square, legalMoves, Masks::bishopMasks[square], Masks::bishopMagic[square], Masks::bishopAttacks[square], QUEEN);
+        generateSlidingMoves<Us>(square, legalMoves, Masks::bishopAttacksFrom(square, occupancy), QUEEN, masks.targets(square));
 
 
         // Clear the least significant bit of the current piece
@@ -734,213 +716,208 @@ LegalMoves Board::GenerateLegalMoves(Color color) const {
     return legalMoves;
 }
 
-inline void Board::generatePawnMoves(const Color color, LegalMoves& legalMoves) const {
-    const uint64_t colorPieces = (color == WHITE) ? whitePieces : blackPieces;
-    const uint64_t oppsitePieces = (color == WHITE) ? blackPieces : whitePieces;
+template<Color Us>
+inline void Board::generateKingMoves(LegalMoves& legalMoves, uint64_t allowed) const {
+    const uint64_t kings = Us == WHITE ? whiteKing : blackKing;
 
-    // Determine the direction based on the pawn color
-    const std::int32_t direction = (color == WHITE) ? 1 : -1;
+    const int square = getLSB(kings);
+    const uint64_t occupancy = whitePieces | blackPieces;
+
+    // the king itself doesn't block a slider that already looks at it
+    uint64_t safe = 0;
+    uint64_t targets = Masks::kingAttack[square] & ~getColorPieces(Us) & allowed;
+    while (targets) {
+        const int target = getLSB(targets);
+        if (!attackersTo<Us>(target, occupancy ^ kings)) {
+            safe |= 1ULL << target;
+        }
+        targets &= targets - 1;
+    }
+
+    generateNonSlidingMoves<Us>(square, legalMoves, safe, KING);
+}
+
+template<Color Us>
+inline void Board::generateCastleMoves(LegalMoves& legalMoves, const MoveMasks& masks) const {
+    constexpr uint64_t WHITE_KINGSIDE_EMPTY = 0x0000000000000060ULL;  // Squares f1 and g1 are empty
+    constexpr uint64_t BLACK_KINGSIDE_EMPTY = 0x6000000000000000ULL;  // Squares f8 and g8 are empty
+    constexpr uint64_t WHITE_QUEENSIDE_EMPTY = 0x000000000000000EULL;  // Squares b1, c1, and d1 are empty
+    constexpr uint64_t BLACK_QUEENSIDE_EMPTY = 0x0E00000000000000ULL;  // Squares b8, c8, and d8 are empty
+
+    const int square = masks.king;
+    const uint64_t occupancy = whitePieces | blackPieces;
+
+    // Check if castling is allowed for the current Us, never out of check
+    const bool canCastleKingside = !masks.checkers && (castleFlags & (Us == WHITE ? WHITE_KINGSIDE_CASTLING : BLACK_KINGSIDE_CASTLING)) != 0;
+    const bool canCastleQueenside = !masks.checkers && (castleFlags & (Us == WHITE ? WHITE_QUEENSIDE_CASTLING : BLACK_QUEENSIDE_CASTLING)) != 0;
+
+    // Generate kingside castle move
+    if (canCastleKingside) {
+        // Check if the squares between the king and rook are unoccupied and the king doesn't pass through check
+        const uint64_t kingsideEmpty = (Us == WHITE) ? WHITE_KINGSIDE_EMPTY : BLACK_KINGSIDE_EMPTY;
+        if ((kingsideEmpty & occupancy) == 0 && !attackersTo<Us>(square + 1, occupancy) && !attackersTo<Us>(square + 2, occupancy)) {
+            const uint32_t target = (Us == WHITE) ? 6 : 62;
+            legalMoves.emplace_back(square, target, KING_CASTLE, Us, KING);
+        }
+    }
+
+    // Generate queenside castle move
+    if (canCastleQueenside) {
+        // Check if the squares between the king and rook are unoccupied
+        const uint64_t queensideEmpty = (Us == WHITE) ? WHITE_QUEENSIDE_EMPTY : BLACK_QUEENSIDE_EMPTY;
+        if ((queensideEmpty & occupancy) == 0 && !attackersTo<Us>(square - 1, occupancy) && !attackersTo<Us>(square - 2, occupancy)) {
+            const uint32_t target = (Us == WHITE) ? 2 : 58;
+            legalMoves.emplace_back(square, target, QUEEN_CASTLE, Us, KING);
+        }
+    }
+}
+
+template<Color Us>
+inline void Board::generatePawnMoves(LegalMoves& legalMoves, const MoveMasks& masks) const {
+    generatePawnPushes<Us>(legalMoves, masks);
+    generatePawnAttacks<Us>(legalMoves, masks);
+}
+
+template<Color Us>
+inline void Board::generatePawnPushes(LegalMoves& legalMoves, const MoveMasks& masks) const {
+    // Determine the direction based on the pawn Us
+    const std::int32_t direction = (Us == WHITE) ? 1 : -1;
 
     // Generate pawn moves
-    const uint64_t pawns = (color == WHITE) ? whitePawns : blackPawns;
-    uint64_t pawnMoves = ((color == WHITE) ? (pawns << 8) : (pawns >> 8)) & ~(whitePieces | blackPieces);
+    const uint64_t pawns = (Us == WHITE) ? whitePawns : blackPawns;
+    uint64_t pawnMoves = ((Us == WHITE) ? (pawns << 8) : (pawns >> 8)) & ~(whitePieces | blackPieces);
 
     while (pawnMoves != 0) {
         const std::int32_t targetSquare = getLSB(pawnMoves);
         const std::int32_t sourceSquare = targetSquare - (direction * 8);
 
         // Check if the pawn is on the starting rank and can make a double move
-        const std::int32_t startingRank = (color == WHITE) ? 1 : 6;
+        const std::int32_t startingRank = (Us == WHITE) ? 1 : 6;
         if ((sourceSquare / 8) == startingRank) {
             const std::int32_t doubleMoveTarget = targetSquare + (direction * 8);
-            if (!isSquareOccupied(doubleMoveTarget)) {
-                legalMoves.emplace_back(sourceSquare, doubleMoveTarget, DOUBLE_PUSH, color, PAWN);
+            if (!isSquareOccupied(doubleMoveTarget) && masks.allows(sourceSquare, doubleMoveTarget)) {
+                legalMoves.emplace_back(sourceSquare, doubleMoveTarget, DOUBLE_PUSH, Us, PAWN);
             }
         }
 
         // Check if the capture is a pawn promotion
-        const std::int32_t promotionRank = (color == WHITE) ? 7 : 0;
-        if ((targetSquare / 8) == promotionRank) {
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, KNIGHT);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, BISHOP);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, ROOK);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, QUEEN);
+        const std::int32_t promotionRank = (Us == WHITE) ? 7 : 0;
+        if (!masks.allows(sourceSquare, targetSquare)) {
+            // pinned or not stopping a check
+        }
+        else if ((targetSquare / 8) == promotionRank) {
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, KNIGHT);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, BISHOP);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, ROOK);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, QUEEN);
         }
         else {
             // Add pawn move to legalMoves
-            legalMoves.emplace_back(sourceSquare, targetSquare, QUIET_MOVE, color, PAWN);
+            legalMoves.emplace_back(sourceSquare, targetSquare, QUIET_MOVE, Us, PAWN);
         }
 
         pawnMoves &= pawnMoves - 1; // Clear the LSB to move to the next move
     }
-
-    // Generate pawn captures
-    uint64_t pawnLeftCaptures = ((((color == WHITE) ? (pawns << 8) : (pawns >> 8)) >> 1) & ~(0x8080808080808080ULL)) & oppsitePieces;
-    uint64_t pawnRightCaptures = ((((color == WHITE) ? (pawns << 8) : (pawns >> 8)) << 1) & ~(0x0101010101010101ULL)) & oppsitePieces;
-
-    while (pawnLeftCaptures != 0) {
-        const std::int32_t targetSquare = getLSB(pawnLeftCaptures);
-        const std::int32_t sourceSquare = targetSquare - (direction * 8) + 1;
-
-        // Check if the capture is a pawn promotion
-        const std::int32_t promotionRank = (color == WHITE) ? 7 : 0;
-        const Piece capturedPiece = getPiece(targetSquare);
-        if ((targetSquare / 8) == promotionRank) {
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, KNIGHT, capturedPiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, BISHOP, capturedPiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, ROOK, capturedPiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, QUEEN, capturedPiece);
-        }
-        else {
-            legalMoves.emplace_back(sourceSquare, targetSquare, CAPTURE, color, PAWN, capturedPiece);
-        }
-
-        pawnLeftCaptures &= pawnLeftCaptures - 1; // Clear the LSB to move to the next capture
-    }
-
-    while (pawnRightCaptures != 0) {
-        const std::int32_t targetSquare = getLSB(pawnRightCaptures);
-        const std::int32_t sourceSquare = targetSquare - (direction * 8) - 1;
-
-        // Check if the capture is a pawn promotion
-        const std::int32_t promotionRank = (color == WHITE) ? 7 : 0;
-        const Piece capturedPiece = getPiece(targetSquare);
-
-        if ((targetSquare / 8) == promotionRank) {
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, KNIGHT, capturedPiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, BISHOP, capturedPiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, ROOK, capturedPiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, QUEEN, capturedPiece);
-        }
-        else {
-            legalMoves.emplace_back(sourceSquare, targetSquare, CAPTURE, color, PAWN, capturedPiece);
-        }
-
-        pawnRightCaptures &= pawnRightCaptures - 1; // Clear the LSB to move to the next capture
-    }
-
-    // Check en passant
-    if (enPassantSquare != -1) {
-        const std::int32_t enPassantOffset = (color == WHITE) ? -8 : 8;
-        const std::int32_t enPassantFile = (enPassantSquare % 8);
-
-        const std::int32_t leftCaptureSquare = enPassantSquare + enPassantOffset - 1;
-        const std::int32_t rightCaptureSquare = enPassantSquare + enPassantOffset + 1;
-
-        if (enPassantFile > 0 && leftCaptureSquare >= 0 && leftCaptureSquare < 64) {
-            const uint64_t enPassantLeftCaptureMask = 1ULL << leftCaptureSquare;
-            if (pawns & enPassantLeftCaptureMask) {
-                legalMoves.emplace_back(leftCaptureSquare, enPassantSquare, EN_PASSANT_CAPTURE, color, PAWN, PAWN);
-            }
-        }
-
-        if (enPassantFile < 7 && rightCaptureSquare >= 0 && rightCaptureSquare < 64) {
-            const uint64_t enPassantRightCaptureMask = 1ULL << rightCaptureSquare;
-            if (pawns & enPassantRightCaptureMask) {
-                legalMoves.emplace_back(rightCaptureSquare, enPassantSquare, EN_PASSANT_CAPTURE, color, PAWN, PAWN);
-            }
-        }
-    }
 }
 
 
+template<Color Us>
 inline void Board::generateNonSlidingMoves(const std::int32_t square, LegalMoves& legalMoves, uint64_t mask, Piece piece) const {
-    const uint64_t pieces = (whitePieces & (1ULL << square)) ? whitePieces : blackPieces;
-    const uint64_t oppsitePieces = (whitePieces & (1ULL << square)) ? blackPieces : whitePieces;
+    const uint64_t pieces = Us == WHITE ? whitePieces : blackPieces;
+    const uint64_t oppsitePieces = Us == WHITE ? blackPieces : whitePieces;
 
     uint64_t captureMoves = (mask & ~pieces) & oppsitePieces;
     uint64_t nonCaptureMoves = (mask & ~pieces) & ~oppsitePieces;
 
     while (captureMoves != 0) {
         const uint32_t target = getLSB(captureMoves);
-        const Color targetColor = (whitePieces & (1ULL << square)) ? WHITE : BLACK;
         const Piece capturedPiece = getPiece(target);
-        legalMoves.emplace_back(square, target, CAPTURE, targetColor, piece, capturedPiece);
+        legalMoves.emplace_back(square, target, CAPTURE, Us, piece, capturedPiece);
         captureMoves &= ~(1ULL << target);
     }
 
     while (nonCaptureMoves != 0) {
         const uint32_t target = getLSB(nonCaptureMoves);
-        const Color targetColor = (whitePieces & (1ULL << square)) ? WHITE : BLACK;
-        legalMoves.emplace_back(square, target, QUIET_MOVE, targetColor, piece);
+        legalMoves.emplace_back(square, target, QUIET_MOVE, Us, piece);
         nonCaptureMoves &= ~(1ULL << target);
     }
 }
 
 
-inline void Board::generateSlidingMoves(std::int32_t square, LegalMoves& legalMoves, uint64_t mask, uint64_t magic_number, uint64_t attacks[4096], Piece piece) const {
-    uint64_t occupancy = ((whitePieces | blackPieces) & mask);
+template<Color Us>
+inline void Board::generateSlidingMoves(std::int32_t square, LegalMoves& legalMoves, uint64_t attacks, Piece piece, uint64_t allowed) const {
+    uint64_t attack = attacks & allowed;
 
-    uint64_t index = (occupancy * magic_number) >> (64 - countBits(mask));
-
-    uint64_t attack = attacks[index];
-
-    uint64_t capture = attack & ((whitePieces & (1ULL << square)) ? blackPieces : whitePieces);
+    uint64_t capture = attack & (Us == WHITE ? blackPieces : whitePieces);
 
     attack &= ~(whitePieces | blackPieces);
     while (attack != 0) {
         const uint32_t target = getLSB(attack);
-        const Color targetColor = (whitePieces & (1ULL << square)) ? WHITE : BLACK;
-        legalMoves.emplace_back(square, target, QUIET_MOVE, targetColor, piece);
+        legalMoves.emplace_back(square, target, QUIET_MOVE, Us, piece);
         attack &= ~(1ULL << target);
     }
 
     while (capture != 0) {
         const uint32_t target = getLSB(capture);
-        const Color targetColor = (whitePieces & (1ULL << square)) ? WHITE : BLACK;
         const Piece capturedPiece = getPiece(target);
-        legalMoves.emplace_back(square, target, CAPTURE, targetColor, piece, capturedPiece);
+        legalMoves.emplace_back(square, target, CAPTURE, Us, piece, capturedPiece);
         capture &= ~(1ULL << target);
     }
 }
 
-LegalMoves Board::GenerateCaptureMoves(Color color) const {
+template<Color Us>
+LegalMoves Board::generateCaptureMoves() const {
     LegalMoves legalMoves;
 
-    generatePawnAttacks(color, legalMoves);
+    const MoveMasks masks = getMoveMasks<Us>();
+    const uint64_t occupancy = whitePieces | blackPieces;
+
+    generatePawnAttacks<Us>(legalMoves, masks);
 
 
-    uint64_t knights = color == WHITE ? whiteKnights : blackKnights;
+    uint64_t knights = Us == WHITE ? whiteKnights : blackKnights;
 
     while (knights) {
         const int square = getLSB(knights);
 
-        generateNonSlidingAttacks(square, legalMoves, Masks::knightAttack[square], KNIGHT);
+        generateNonSlidingAttacks<Us>(square, legalMoves, Masks::knightAttack[square] & masks.targets(square), KNIGHT);
 
         // Clear the least significant bit of the current piece
         knights &= (knights - 1);
     }
 
-    uint64_t bishops = color == WHITE ? whiteBishops : blackBishops;
+    generateKingMoves<Us>(legalMoves, getColorPieces(Us == WHITE ? BLACK : WHITE));
+
+    uint64_t bishops = Us == WHITE ? whiteBishops : blackBishops;
 
     while (bishops) {
         const int square = getLSB(bishops);
 
-        generateSlidingAttacks(square, legalMoves, Masks::bishopMasks[square], Masks::bishopMagic[square], Masks::bishopAttacks[square], BISHOP);
+        generateSlidingAttacks<Us>(square, legalMoves, Masks::bishopAttacksFrom(square, occupancy), BISHOP, masks.targets(square));
 
         // Clear the least significant bit of the current piece
         bishops &= (bishops - 1);
     }
 
-    uint64_t rooks = color == WHITE ? whiteRooks : blackRooks;
+    uint64_t rooks = Us == WHITE ? whiteRooks : blackRooks;
 
     while (rooks) {
         const int square = getLSB(rooks);
 
-        generateSlidingAttacks(square, legalMoves, Masks::rookMasks[square], Masks::rookMagic[square], Masks::rookAttacks[square], ROOK);
+        generateSlidingAttacks<Us>(square, legalMoves, Masks::rookAttacksFrom(square, occupancy), ROOK, masks.targets(square));
 
         // Clear the least significant bit of the current piece
         rooks &= (rooks - 1);
     }
 
-    uint64_t queens = color == WHITE ? whiteQueens : blackQueens;
+    uint64_t queens = Us == WHITE ? whiteQueens : blackQueens;
 
     while (queens) {
         const int square = getLSB(queens);
 
-        generateSlidingAttacks(square, legalMoves, Masks::rookMasks[square], Masks::rookMagic[square], Masks::rookAttacks[square], QUEEN);
+        generateSlidingAttacks<Us>(square, legalMoves, Masks::rookAttacksFrom(square, occupancy), QUEEN, masks.targets(square));
 
-        generateSlidingAttacks(square, legalMoves, Masks::bishopMasks[square], Masks::bishopMagic[square], Masks::bishopAttacks[square], QUEEN);
+        generateSlidingAttacks<Us>(square, legalMoves, Masks::bishopAttacksFrom(square, occupancy), QUEEN, masks.targets(square));
 
 
         // Clear the least significant bit of the current piece
@@ -951,33 +928,97 @@ LegalMoves Board::GenerateCaptureMoves(Color color) const {
     return legalMoves;
 }
 
+template<Color Us>
+LegalMoves Board::generateQuietMoves() const {
+    LegalMoves legalMoves;
+
+    const MoveMasks masks = getMoveMasks<Us>();
+    const uint64_t occupancy = whitePieces | blackPieces;
+    const uint64_t empty = ~occupancy;
+
+    generatePawnPushes<Us>(legalMoves, masks);
+
+    uint64_t knights = Us == WHITE ? whiteKnights : blackKnights;
+
+    while (knights) {
+        const int square = getLSB(knights);
+
+        generateNonSlidingMoves<Us>(square, legalMoves, Masks::knightAttack[square] & masks.targets(square) & empty, KNIGHT);
+
+        // Clear the least significant bit of the current piece
+        knights &= (knights - 1);
+    }
+
+    generateKingMoves<Us>(legalMoves, empty);
+    generateCastleMoves<Us>(legalMoves, masks);
+
+    uint64_t bishops = Us == WHITE ? whiteBishops : blackBishops;
+
+    while (bishops) {
+        const int square = getLSB(bishops);
+
+        generateSlidingMoves<Us>(square, legalMoves, Masks::bishopAttacksFrom(square, occupancy), BISHOP, masks.targets(square) & empty);
+
+        // Clear the least significant bit of the current piece
+        bishops &= (bishops - 1);
+    }
+
+    uint64_t rooks = Us == WHITE ? whiteRooks : blackRooks;
+
+    while (rooks) {
+        const int square = getLSB(rooks);
+
+        generateSlidingMoves<Us>(square, legalMoves, Masks::rookAttacksFrom(square, occupancy), ROOK, masks.targets(square) & empty);
+
+        // Clear the least significant bit of the current piece
+        rooks &= (rooks - 1);
+    }
+
+    uint64_t queens = Us == WHITE ? whiteQueens : blackQueens;
+
+    while (queens) {
+        const int square = getLSB(queens);
+
+        generateSlidingMoves<Us>(square, legalMoves, Masks::rookAttacksFrom(square, occupancy), QUEEN, masks.targets(square) & empty);
+
+        generateSlidingMoves<Us>(square, legalMoves, Masks::bishopAttacksFrom(square, occupancy), QUEEN, masks.targets(square) & empty);
+
+
+        // Clear the least significant bit of the current piece
+        queens &= (queens - 1);
+    }
+
+    return legalMoves;
+}
+
+template<Color Us>
 inline void Board::generateNonSlidingAttacks(const std::int32_t square, LegalMoves& legalMoves, uint64_t mask, Piece piece) const {
-    const uint64_t pieces = (whitePieces & (1ULL << square)) ? whitePieces : blackPieces;
-    const uint64_t oppsitePieces = (whitePieces & (1ULL << square)) ? blackPieces : whitePieces;
+    const uint64_t pieces = Us == WHITE ? whitePieces : blackPieces;
+    const uint64_t oppsitePieces = Us == WHITE ? blackPieces : whitePieces;
 
     uint64_t captureMoves = (mask & ~pieces) & oppsitePieces;
 
     while (captureMoves != 0) {
         const uint32_t target = getLSB(captureMoves);
-        const Color targetColor = (whitePieces & (1ULL << square)) ? WHITE : BLACK;
         const Piece capturedPiece = getPiece(target);
-        legalMoves.emplace_back(square, target, CAPTURE, targetColor, piece, capturedPiece);
+        legalMoves.emplace_back(square, target, CAPTURE, Us, piece, capturedPiece);
         captureMoves &= ~(1ULL << target);
     }
 }
 
-inline void Board::generatePawnAttacks(const Color color, LegalMoves& legalMoves) const {
-    const uint64_t oppsitePieces = (color == WHITE) ? blackPieces : whitePieces;
+template<Color Us>
+inline void Board::generatePawnAttacks(LegalMoves& legalMoves, const MoveMasks& masks) const {
+    const uint64_t oppsitePieces = (Us == WHITE) ? blackPieces : whitePieces;
 
-    // Determine the direction based on the pawn color
-    const std::int32_t direction = (color == WHITE) ? 1 : -1;
+    // Determine the direction based on the pawn Us
+    const std::int32_t direction = (Us == WHITE) ? 1 : -1;
 
     // Generate pawn moves
-    const uint64_t pawns = (color == WHITE) ? whitePawns : blackPawns;
+    const uint64_t pawns = (Us == WHITE) ? whitePawns : blackPawns;
 
     // Generate pawn captures
-    uint64_t pawnLeftCaptures = ((((color == WHITE) ? (pawns << 8) : (pawns >> 8)) >> 1) & ~(0x8080808080808080ULL)) & oppsitePieces;
-    uint64_t pawnRightCaptures = ((((color == WHITE) ? (pawns << 8) : (pawns >> 8)) << 1) & ~(0x0101010101010101ULL)) & oppsitePieces;
+    uint64_t pawnLeftCaptures = ((((Us == WHITE) ? (pawns << 8) : (pawns >> 8)) >> 1) & ~(0x8080808080808080ULL)) & oppsitePieces;
+    uint64_t pawnRightCaptures = ((((Us == WHITE) ? (pawns << 8) : (pawns >> 8)) << 1) & ~(0x0101010101010101ULL)) & oppsitePieces;
 
     while (pawnLeftCaptures != 0) {
         const std::int32_t targetSquare = getLSB(pawnLeftCaptures);
@@ -985,15 +1026,18 @@ inline void Board::generatePawnAttacks(const Color color, LegalMoves& legalMoves
 
         // Check if the capture is a pawn promotion
         Piece targetpiece = getPiece(targetSquare);
-        const std::int32_t promotionRank = (color == WHITE) ? 7 : 0;
-        if ((targetSquare / 8) == promotionRank) {
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, KNIGHT, targetpiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, BISHOP, targetpiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, ROOK, targetpiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, QUEEN, targetpiece);
+        const std::int32_t promotionRank = (Us == WHITE) ? 7 : 0;
+        if (!masks.allows(sourceSquare, targetSquare)) {
+            // pinned or not stopping a check
+        }
+        else if ((targetSquare / 8) == promotionRank) {
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, KNIGHT, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, BISHOP, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, ROOK, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, QUEEN, targetpiece);
         }
         else {
-            legalMoves.emplace_back(sourceSquare, targetSquare, CAPTURE, color, PAWN, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, CAPTURE, Us, PAWN, targetpiece);
         }
 
         pawnLeftCaptures &= pawnLeftCaptures - 1; // Clear the LSB to move to the next capture
@@ -1006,16 +1050,19 @@ inline void Board::generatePawnAttacks(const Color color, LegalMoves& legalMoves
         Piece targetpiece = getPiece(targetSquare);
 
         // Check if the capture is a pawn promotion
-        const std::int32_t promotionRank = (color == WHITE) ? 7 : 0;
+        const std::int32_t promotionRank = (Us == WHITE) ? 7 : 0;
 
-        if ((targetSquare / 8) == promotionRank) {
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, KNIGHT, targetpiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, BISHOP, targetpiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, ROOK, targetpiece);
-            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, color, QUEEN, targetpiece);
+        if (!masks.allows(sourceSquare, targetSquare)) {
+            // pinned or not stopping a check
+        }
+        else if ((targetSquare / 8) == promotionRank) {
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, KNIGHT, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, BISHOP, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, ROOK, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, PROMOTE, Us, QUEEN, targetpiece);
         }
         else {
-            legalMoves.emplace_back(sourceSquare, targetSquare, CAPTURE, color, PAWN, targetpiece);
+            legalMoves.emplace_back(sourceSquare, targetSquare, CAPTURE, Us, PAWN, targetpiece);
         }
 
         pawnRightCaptures &= pawnRightCaptures - 1; // Clear the LSB to move to the next capture
@@ -1023,7 +1070,7 @@ inline void Board::generatePawnAttacks(const Color color, LegalMoves& legalMoves
 
     // Check en passant
     if (enPassantSquare != -1) {
-        const std::int32_t enPassantOffset = (color == WHITE) ? -8 : 8;
+        const std::int32_t enPassantOffset = (Us == WHITE) ? -8 : 8;
         const std::int32_t enPassantFile = (enPassantSquare % 8);
 
         const std::int32_t leftCaptureSquare = enPassantSquare + enPassantOffset - 1;
@@ -1031,67 +1078,278 @@ inline void Board::generatePawnAttacks(const Color color, LegalMoves& legalMoves
 
         if (enPassantFile > 0 && leftCaptureSquare >= 0 && leftCaptureSquare < 64) {
             const uint64_t enPassantLeftCaptureMask = 1ULL << leftCaptureSquare;
-            if (pawns & enPassantLeftCaptureMask) {
-                legalMoves.emplace_back(leftCaptureSquare, enPassantSquare, EN_PASSANT_CAPTURE, color, PAWN, PAWN);
+            if ((pawns & enPassantLeftCaptureMask) && isEnPassantLegal<Us>(leftCaptureSquare, masks)) {
+                legalMoves.emplace_back(leftCaptureSquare, enPassantSquare, EN_PASSANT_CAPTURE, Us, PAWN, PAWN);
             }
         }
 
         if (enPassantFile < 7 && rightCaptureSquare >= 0 && rightCaptureSquare < 64) {
             const uint64_t enPassantRightCaptureMask = 1ULL << rightCaptureSquare;
-            if (pawns & enPassantRightCaptureMask) {
-                legalMoves.emplace_back(rightCaptureSquare, enPassantSquare, EN_PASSANT_CAPTURE, color, PAWN, PAWN);
+            if ((pawns & enPassantRightCaptureMask) && isEnPassantLegal<Us>(rightCaptureSquare, masks)) {
+                legalMoves.emplace_back(rightCaptureSquare, enPassantSquare, EN_PASSANT_CAPTURE, Us, PAWN, PAWN);
             }
         }
     }
 }
 
 
-inline void Board::generateSlidingAttacks(std::int32_t square, LegalMoves& legalMoves, uint64_t mask, uint64_t magic_number, uint64_t attacks[4096], Piece piece) const {
-    uint64_t occupancy = ((whitePieces | blackPieces) & mask);
-
-    uint64_t index = (occupancy * magic_number) >> (64 - countBits(mask));
-
-    uint64_t attack = attacks[index];
+template<Color Us>
+inline void Board::generateSlidingAttacks(std::int32_t square, LegalMoves& legalMoves, uint64_t attacks, Piece piece, uint64_t allowed) const {
+    uint64_t attack = attacks & allowed;
 
-    uint64_t capture = attack & ((whitePieces & (1ULL << square)) ? blackPieces : whitePieces);
+    uint64_t capture = attack & (Us == WHITE ? blackPieces : whitePieces);
 
     while (capture != 0) {
         const uint32_t target = getLSB(capture);
-        const Color targetColor = (whitePieces & (1ULL << square)) ? WHITE : BLACK;
         const Piece capturedPiece = getPiece(target);
-        legalMoves.emplace_back(square, target, CAPTURE, targetColor, piece, capturedPiece);
+        legalMoves.emplace_back(square, target, CAPTURE, Us, piece, capturedPiece);
         capture &= ~(1ULL << target);
     }
 }
 
-uint64_t Board::generateNonSlidingMovesAsBits(std::int32_t square, uint64_t mask, Piece piece) const {
-    const uint64_t pieces = (whitePieces & (1ULL << square)) ? whitePieces : blackPieces;
-    const uint64_t oppositePieces = (whitePieces & (1ULL << square)) ? blackPieces : whitePieces;
+template<Color Us>
+uint64_t Board::attackersTo(int square, uint64_t occupancy) const {
+    const uint64_t bit = 1ULL << square;
 
-    uint64_t moves = (mask & ~pieces) & oppositePieces;
+    // the squares a pawn of the other side attacks this square from, the file masks stop wrapping around the board
+    const uint64_t pawnSquares = Us == WHITE
+        ? ((bit << 7) & ~0x8080808080808080ULL) | ((bit << 9) & ~0x0101010101010101ULL)
+        : ((bit >> 9) & ~0x8080808080808080ULL) | ((bit >> 7) & ~0x0101010101010101ULL);
 
-    return moves;
+    const uint64_t queens = Us == WHITE ? blackQueens : whiteQueens;
+
+    return (pawnSquares & (Us == WHITE ? blackPawns : whitePawns))
+        | (Masks::knightAttack[square] & (Us == WHITE ? blackKnights : whiteKnights))
+        | (Masks::kingAttack[square] & (Us == WHITE ? blackKing : whiteKing))
+        | (Masks::bishopAttacksFrom(square, occupancy) & ((Us == WHITE ? blackBishops : whiteBishops) | queens))
+        | (Masks::rookAttacksFrom(square, occupancy) & ((Us == WHITE ? blackRooks : whiteRooks) | queens));
 }
 
 
-uint64_t Board::generateSlidingMovesAsBits(std::int32_t square, uint64_t mask, uint64_t magic_number, const uint64_t attacks[4096], Piece piece) const {
-    uint64_t occupancy = ((whitePieces | blackPieces) & mask);
-    uint64_t index = (occupancy * magic_number) >> (64 - countBits(mask));
-    uint64_t attack = attacks[index];
+template<Color Us>
+MoveMasks Board::getMoveMasks() const {
+    MoveMasks masks;
+
+    const uint64_t occupancy = whitePieces | blackPieces;
+    const uint64_t own = getColorPieces(Us);
+    const uint64_t queens = Us == WHITE ? blackQueens : whiteQueens;
+    const uint64_t bishops = (Us == WHITE ? blackBishops : whiteBishops) | queens;
+    const uint64_t rooks = (Us == WHITE ? blackRooks : whiteRooks) | queens;
+
+    masks.king = getLSB(Us == WHITE ? whiteKing : blackKing);
+    masks.checkers = attackersTo<Us>(masks.king, occupancy);
+
+    if (!masks.checkers) {
+        masks.checkMask = ~0ULL;
+    }
+    else if (!(masks.checkers & (masks.checkers - 1))) {
+        masks.checkMask = masks.checkers | Masks::between[masks.king][getLSB(masks.checkers)];
+    }
+    else {
+        masks.checkMask = 0;
+    }
 
-    uint64_t moves = attack & ~(((whitePieces & (1ULL << square)) ? whitePieces : blackPieces));
+    // sliders that see the king with the own pieces taken off, a single own piece in between is pinned
+    uint64_t snipers = (Masks::bishopAttacksFrom(masks.king, occupancy & ~own) & bishops) | (Masks::rookAttacksFrom(masks.king, occupancy & ~own) & rooks);
 
-    return moves;
+    masks.pinned = 0;
+    while (snipers) {
+        const uint64_t blockers = Masks::between[masks.king][getLSB(snipers)] & occupancy;
+        if (!(blockers & (blockers - 1))) {
+            masks.pinned |= blockers & own;
+        }
+        snipers &= snipers - 1;
+    }
+
+    return masks;
 }
 
 
+template<Color Us>
+bool Board::isEnPassantLegal(int from, const MoveMasks& masks) const {
+    const int captured = enPassantSquare + (Us == WHITE ? -8 : 8);
+    const uint64_t occupancy = ((whitePieces | blackPieces) ^ (1ULL << from) ^ (1ULL << captured)) | (1ULL << enPassantSquare);
 
-bool Board::isSqaureAttacked(Color color, int square) const {
-    uint64_t pawns = color == WHITE ? blackPawns : whitePawns;
+    return !(attackersTo<Us>(masks.king, occupancy) & ~(1ULL << captured));
+}
+
+
+template<Color Us>
+Move Board::legalMove(Move move) const {
+    if (move == Move()) {
+        return Move();
+    }
+
+    const int from = move.getFrom();
+    const int to = move.getTo();
+    const MoveFlag flags = move.getFlags();
+
+    const uint64_t own = getColorPieces(Us);
+    const uint64_t occupancy = whitePieces | blackPieces;
+
+    if (!((own >> from) & 1) || ((own >> to) & 1)) {
+        return Move();
+    }
+
+    const Piece piece = getPiece(from);
+    const Piece captured = getPiece(to);
+    const MoveMasks masks = getMoveMasks<Us>();
 
-    uint64_t knights = color == WHITE ? blackKnights : whiteKnights;
+    if (piece == PAWN) {
+        const int forward = Us == WHITE ? 8 : -8;
+        const bool lastRank = (to / 8) == (Us == WHITE ? 7 : 0);
+        const bool diagonal = (to == from + forward - 1 || to == from + forward + 1) && std::abs(to % 8 - from % 8) == 1;
 
-    if (color == WHITE) {
+        if (flags == EN_PASSANT_CAPTURE) {
+            if (to == enPassantSquare && diagonal && isEnPassantLegal<Us>(from, masks)) {
+                return Move(from, to, EN_PASSANT_CAPTURE, Us, PAWN, PAWN);
+            }
+            return Move();
+        }
+
+        bool reaches;
+        switch (flags) {
+        case QUIET_MOVE:
+            reaches = !lastRank && to == from + forward && captured == EMPTY;
+            break;
+        case DOUBLE_PUSH:
+            reaches = (from / 8) == (Us == WHITE ? 1 : 6) && to == from + 2 * forward && !((occupancy >> (from + forward)) & 1) && captured == EMPTY;
+            break;
+        case CAPTURE:
+            reaches = !lastRank && diagonal && captured != EMPTY;
+            break;
+        case PROMOTE:
+            reaches = lastRank && (to == from + forward ? captured == EMPTY : diagonal && captured != EMPTY);
+            break;
+        default:
+            reaches = false;
+        }
+
+        if (!reaches || !masks.allows(from, to)) {
+            return Move();
+        }
+
+        if (flags == PROMOTE) {
+            const Piece promoted = move.getPiece();
+            return Move(from, to, PROMOTE, Us, promoted == KNIGHT || promoted == BISHOP || promoted == ROOK ? promoted : QUEEN, captured);
+        }
+        return Move(from, to, flags, Us, PAWN, captured);
+    }
+
+    if (piece == KING && (flags == KING_CASTLE || flags == QUEEN_CASTLE)) {
+        LegalMoves castles;
+        generateCastleMoves<Us>(castles, masks);
+        for (int i = 0; i < castles.count; i++) {
+            if (castles.moves[i] == move) {
+                return castles.moves[i];
+            }
+        }
+        return Move();
+    }
+
+    if (flags != (captured == EMPTY ? QUIET_MOVE : CAPTURE)) {
+        return Move();
+    }
+
+    if (piece == KING) {
+        const uint64_t king = 1ULL << from;
+        if (!((Masks::kingAttack[from] >> to) & 1) || attackersTo<Us>(to, occupancy ^ king)) {
+            return Move();
+        }
+        return Move(from, to, flags, Us, KING, captured);
+    }
+
+    uint64_t reach;
+    switch (piece) {
+    case KNIGHT:
+        reach = Masks::knightAttack[from];
+        break;
+    case BISHOP:
+        reach = Masks::bishopAttacksFrom(from, occupancy);
+        break;
+    case ROOK:
+        reach = Masks::rookAttacksFrom(from, occupancy);
+        break;
+    default:
+        reach = Masks::bishopAttacksFrom(from, occupancy) | Masks::rookAttacksFrom(from, occupancy);
+    }
+
+    if (!((reach & masks.targets(from)) >> to & 1)) {
+        return Move();
+    }
+    return Move(from, to, flags, Us, piece, captured);
+}
+
+
+// only what the pieces are worth to each other, the king is worth more than anything it could win
+constexpr static int exchangeValue[7] = { 0, 900, 20000, 500, 300, 325, 100 };
+
+bool Board::StaticExchange(Move move, int threshold) const {
+    const int to = move.getTo();
+    const Piece captured = move.getCapturedPiece();
+
+    if (move.getFlags() == EN_PASSANT_CAPTURE || move.getFlags() == PROMOTE) {
+        return exchangeValue[captured] >= threshold;
+    }
+
+    Piece attacker = getPiece(move.getFrom());
+
+    // nothing the other side takes back can make it worse than giving up the capturing piece
+    if (exchangeValue[captured] - exchangeValue[attacker] >= threshold) {
+        return true;
+    }
+
+    // the swap list, gain[d] is what the side making the d-th capture has if the exchange stopped after it
+    int gain[32];
+    int d = 0;
+    gain[0] = exchangeValue[captured] - threshold;
+
+    uint64_t occupancy = whitePieces | blackPieces;
+    uint64_t fromBit = 1ULL << move.getFrom();
+    Color side = currentPlayer;
+
+    while (d < 31) {
+        d++;
+        gain[d] = exchangeValue[attacker] - gain[d - 1];
+        if (std::max(-gain[d - 1], gain[d]) < 0) {
+            break;
+        }
+
+        occupancy ^= fromBit;
+        side = side == WHITE ? BLACK : WHITE;
+
+        // attackersTo gives the other side's pieces, looking through the ones that already took
+        const uint64_t attackers = (side == WHITE ? attackersTo<BLACK>(to, occupancy) : attackersTo<WHITE>(to, occupancy)) & occupancy;
+        if (!attackers) {
+            break;
+        }
+
+        constexpr Piece order[6] = { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
+        for (Piece piece : order) {
+            const uint64_t pieces = attackers & getPieces(side, piece);
+            if (pieces) {
+                fromBit = pieces & (0 - pieces);
+                attacker = piece;
+                break;
+            }
+        }
+    }
+
+    while (--d) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    }
+
+    return gain[0] >= 0;
+}
+
+
+template<Color Us>
+bool Board::isSquareAttacked(int square) const {
+    uint64_t pawns = Us == WHITE ? blackPawns : whitePawns;
+
+    uint64_t knights = Us == WHITE ? blackKnights : whiteKnights;
+
+    if constexpr (Us == WHITE) {
         if (square % 8 != 7 && (pawns & (1ULL << (square + 9)))) {
             return true;
         }
@@ -1114,27 +1372,23 @@ bool Board::isSqaureAttacked(Color color, int square) const {
         return true;
     }
 
-    uint64_t kings = color == WHITE ? blackKing : whiteKing;
+    uint64_t kings = Us == WHITE ? blackKing : whiteKing;
 
     if (kings & Masks::kingAttack[square]) {
         return true;
     }
 
-    uint64_t queens = color == WHITE ? blackQueens : whiteQueens;
+    uint64_t queens = Us == WHITE ? blackQueens : whiteQueens;
 
-    uint64_t bishops = color == WHITE ? blackBishops : whiteBishops;
+    uint64_t bishops = Us == WHITE ? blackBishops : whiteBishops;
 
-    if ((bishops | queens) & generateSlidingMovesAsBits(square, Masks::bishopMasks[square],
-        Masks::bishopMagic[square], Masks::bishopAttacks[square],
-        BISHOP)) {
+    if ((bishops | queens) & Masks::bishopAttacksFrom(square, whitePieces | blackPieces)) {
         return true;
     }
 
-    uint64_t rooks = color == WHITE ? blackRooks : whiteRooks;
+    uint64_t rooks = Us == WHITE ? blackRooks : whiteRooks;
 
-    if ((rooks | queens) & generateSlidingMovesAsBits(square, Masks::rookMasks[square],
-        Masks::rookMagic[square], Masks::rookAttacks[square],
-        ROOK)) {
+    if ((rooks | queens) & Masks::rookAttacksFrom(square, whitePieces | blackPieces)) {
         return true;
     }
 
@@ -1144,11 +1398,12 @@ bool Board::isSqaureAttacked(Color color, int square) const {
 
 
 
-bool Board::isKingAttacked(Color color) const {
-    int square = getLSB(color == WHITE ? whiteKing : blackKing);
-
+bool Board::isSqaureAttacked(Color color, int square) const {
+    return color == WHITE ? isSquareAttacked<WHITE>(square) : isSquareAttacked<BLACK>(square);
+}
 
-    return isSqaureAttacked(color, square);
+bool Board::isKingAttacked(Color color) const {
+    return color == WHITE ? isSquareAttacked<WHITE>(getLSB(whiteKing)) : isSquareAttacked<BLACK>(getLSB(blackKing));
 }
 
 
@@ -1278,4 +1533,34 @@ uint64_t Board::generateHashKey() const{
     key ^= !currentPlayer * Masks::SideKey;
 
     return key;
-}
\ No newline at end of file
+}
+
+uint64_t Board::generatePawnKey() const {
+    uint64_t key = 0ULL;
+
+    uint64_t pawns = whitePawns;
+    while (pawns) {
+        key ^= Masks::pieceKeys[PAWN - 1][getLSB(pawns)];
+        pawns &= pawns - 1;
+    }
+
+    pawns = blackPawns;
+    while (pawns) {
+        key ^= Masks::pieceKeys[6 + PAWN - 1][getLSB(pawns)];
+        pawns &= pawns - 1;
+    }
+
+    return key;
+}
+
+uint64_t Board::getPieces(Color color, Piece piece) const {
+    switch (piece) {
+    case PAWN: return color == WHITE ? whitePawns : blackPawns;
+    case KNIGHT: return color == WHITE ? whiteKnights : blackKnights;
+    case BISHOP: return color == WHITE ? whiteBishops : blackBishops;
+    case ROOK: return color == WHITE ? whiteRooks : blackRooks;
+    case QUEEN: return color == WHITE ? whiteQueens : blackQueens;
+    case KING: return color == WHITE ? whiteKing : blackKing;
+    default: return 0;
+    }
+}